@@ -0,0 +1,392 @@
+/**
+ * Planner benchmark: runs every planner phase on seeded maps and reports per-round costs
+ *
+ * Build:   g++ -std=c++17 -O2 -pthread bench.cpp -o bench
+ * Usage:   ./bench [options] > bench_output.txt
+ *      --buildings a,b,c   Building counts to sweep (default 3,10,25,50,100,150)
+ *      --astronauts a,b,c  Astronauts per pad per month to sweep (default 10,100,1000)
+ *      --types a,b,c       Module type counts to sweep (default 4,10,20)
+ *      --layouts a,b       uniform and/or clustered (default both)
+ *      --seeds N           Maps per configuration (default 3)
+ *      --rounds N          Rounds played per map (default 20)
+ *      --candidate-allocs  Report the heap traffic of valuing one candidate instead
+ *
+ * Output is CSV, one line per (map, round, phase):
+ *      layout,buildings,astronauts,types,seed,round,phase,time_us,allocs,alloc_bytes,predicted_score
+ * The `round` phase line sums the four others. The predicted score is the summed
+ * route score of the action set picked by apply_best_routes.
+ *
+ * With --candidate-allocs, one line per (map, round, kernel) instead:
+ *      layout,buildings,astronauts,types,seed,round,kernel,candidates,allocs_per_candidate,bytes_per_candidate
+ * Kernels run on every suggested link (every pad for `route_branches`) after a warm-up pass
+ * over all of them, so buffers reused between candidates do not count once they have grown. `design_screen`, `make_paths`
+ * and `race_forecast` take the network with that one link built as the candidate design.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#define JI_NO_MAIN
+#include "ji.cpp"
+#include "mapgen.hpp"
+
+//  █████  ██      ██       ██████   ██████
+// ██   ██ ██      ██      ██    ██ ██
+// ███████ ██      ██      ██    ██ ██
+// ██   ██ ██      ██      ██    ██ ██
+// ██   ██ ███████ ███████  ██████   ██████
+
+static std::atomic<size_t> g_alloc_count{0};
+static std::atomic<size_t> g_alloc_bytes{0};
+
+static void *counted_malloc(size_t size) noexcept {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new(size_t size) {
+    if (void *p = counted_malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return counted_malloc(size); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return counted_malloc(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { std::free(p); }
+
+struct PhaseCounter {
+    std::chrono::steady_clock::time_point   start;
+    size_t                                  allocs, bytes;
+
+    PhaseCounter() { reset(); }
+
+    void reset() {
+        allocs = g_alloc_count.load();
+        bytes = g_alloc_bytes.load();
+        start = std::chrono::steady_clock::now();
+    }
+
+    long long elapsed_us() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+// ██████  ███████ ███    ██  ██████ ██   ██
+// ██   ██ ██      ████   ██ ██      ██   ██
+// ██████  █████   ██ ██  ██ ██      ███████
+// ██   ██ ██      ██  ██ ██ ██      ██   ██
+// ██████  ███████ ██   ████  ██████ ██   ██
+
+struct NullBuffer : std::streambuf {
+    int overflow(int c) override { return c; }
+};
+
+struct BenchConfig {
+    MapLayout   layout;
+    int         buildings, astronauts, types;
+    uint32_t    seed;
+};
+
+static std::vector<int> parse_list(const char *arg) {
+    std::vector<int> values;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        values.push_back(std::atoi(item.c_str()));
+    return values;
+}
+
+/**
+ * What the game would send to the bot this round, built from the model's own view
+ * of the network since the benchmark has no referee to echo it
+ */
+static std::string make_round_input(const SimModel &model, const GameMap &map, int round, int resources) {
+    std::ostringstream ss;
+    ss << resources << "\n";
+    ss << model.tubes.size() + model.teleporters.size() << "\n";
+    for (const auto &[id, tube] : model.tubes)
+        ss << tube->b1->id << " " << tube->b2->id << " " << tube->capacity << "\n";
+    for (const auto &[id, tele] : model.teleporters)
+        ss << tele->b1->id << " " << tele->b2->id << " " << 0 << "\n";
+    ss << model.pods.size() << "\n";
+    for (const auto &[id, pod] : model.pods) {
+        ss << id << " " << pod->route.size();
+        for (int stop : pod->route)
+            ss << " " << stop;
+        ss << "\n";
+    }
+    ss << map.waves[round].size() << "\n";
+    for (const auto &building : map.waves[round])
+        ss << building.to_input_line() << "\n";
+    return ss.str();
+}
+
+// Bill the printed actions the way the referee would, `model` as the bot left it after printing them
+static int spent_on(const std::string &actions, const SimModel &model) {
+    int spent = 0;
+    // The tubes are already upgraded, each upgrade is billed at the capacity it had then
+    std::map<std::pair<int, int>, int> upgrades_left;
+    std::stringstream upgrades(actions);
+    std::string action;
+    while (std::getline(upgrades, action, ';')) {
+        std::istringstream ss(action);
+        std::string verb;
+        int a = 0, b = 0;
+        if (ss >> verb >> a >> b && verb == "UPGRADE")
+            upgrades_left[tube_key(a, b)]++;
+    }
+    std::stringstream all(actions);
+    while (std::getline(all, action, ';')) {
+        std::istringstream ss(action);
+        std::string verb;
+        int a = 0, b = 0;
+        ss >> verb >> a >> b;
+        if (verb == "TUBE" && model.buildings.count(a) && model.buildings.count(b))
+            spent += (int)std::floor(model.buildings.at(a)->get_pos().distance(model.buildings.at(b)->get_pos()) * TUBE_PRICE);
+        else if (verb == "TELEPORT")
+            spent += TELEPORTER_PRICE;
+        else if (verb == "POD")
+            spent += POD_PRICE;
+        else if (verb == "DESTROY")
+            spent -= POD_REFUND;
+        else if (verb == "UPGRADE") {
+            auto tube = model.tubes_by_ends.find(tube_key(a, b));
+            if (tube == model.tubes_by_ends.end())
+                continue;
+            int capacity = tube->second->capacity - upgrades_left[tube_key(a, b)]--;
+            spent += tube_cost(tube->second->b1, tube->second->b2) * (capacity + 1);
+        }
+    }
+    return spent;
+}
+
+static int predicted_score(const std::map<t_actions, t_routes_and_scores> &result_routes_for_links) {
+    int best = 0;
+    for (const auto &[actions, routes_and_scores] : result_routes_for_links) {
+        int added = 0;
+        for (const auto &[score, route] : routes_and_scores)
+            added += score;
+        best = std::max(best, added);
+    }
+    return best;
+}
+
+/**
+ * Heap traffic of the per-candidate kernels of the planner on this round's model
+ */
+static void report_candidate_allocs(const std::string &prefix, int round, SimModel &model,
+    const t_DudeSupplyChain &supply_chain, const t_actions &suggested_links) {
+    auto measure = [&](const char *kernel, size_t candidates, const std::function<void(size_t)> &run) {
+        if (candidates == 0)
+            return;
+        for (size_t i = 0; i < candidates; i++)
+            run(i);
+        size_t allocs = g_alloc_count.load(), bytes = g_alloc_bytes.load();
+        for (size_t i = 0; i < candidates; i++)
+            run(i);
+        allocs = g_alloc_count.load() - allocs;
+        bytes = g_alloc_bytes.load() - bytes;
+        std::cout << prefix << round << "," << kernel << "," << candidates << ","
+                  << (double)allocs / candidates << "," << (double)bytes / candidates << "\n";
+    };
+
+    // Hop counts and balance, what every sampled link goes through
+    LinkValuation valuation(model);
+    valuation.expect_tubes(suggested_links);
+    measure("link_value", suggested_links.size(), [&](size_t i) {
+        const auto &[b1, b2, link_type] = suggested_links[i];
+        estimate_link_value(b1, b2, link_type);
+        estimate_link_value(b2, b1, link_type);
+        redirect_balance_gain(model, valuation, b1, b2, link_type);
+        redirect_balance_gain(model, valuation, b2, b1, link_type);
+    });
+    // The month forecast with the link built
+    measure("speed_forecast", suggested_links.size(), [&](size_t i) {
+        const auto &[b1, b2, link_type] = suggested_links[i];
+        marginal_speed_gain(model, valuation, b1, b2, link_type);
+    });
+
+    // Pod route search of every pad, as make_paths runs it
+    RouteGraph graph;
+    graph.build(model.get_all_links());
+    const std::vector<const LandingPad*> &pads = graph.pads();
+    std::vector<RouteBranch> branches;
+    measure("route_branches", pads.size(), [&](size_t i) {
+        enumerate_route_branches(pads[i], pads[i]->get_dudes(), graph, branches);
+    });
+
+    // One design per suggested link: the network with that link built
+    std::deque<Link> built;
+    std::vector<std::vector<Link*>> link_spaces;
+    for (const auto &[b1, b2, link_type]: suggested_links) {
+        int id = (int)built.size() + (1 << 28);
+        built.emplace_back(b1, b2, link_type == T_TUBE ? id : -id, link_type == T_TUBE ? 1 : 0);
+        link_spaces.push_back(model.get_all_links());
+        link_spaces.back().push_back(&built.back());
+    }
+
+    // What the design search does to an offspring before planning it: repair, then the two bounds
+    LinkConflicts conflicts(model, suggested_links);
+    LinkConflicts::Scratch repairs = conflicts.scratch();
+    DesignScreen screen(model, suggested_links);
+    ModelOverlay overlay(model);
+    std::vector<char> genome(suggested_links.size(), 0);
+    measure("design_screen", suggested_links.size(), [&](size_t i) {
+        genome[i] = 1;
+        int cost = conflicts.repair(genome, repairs);
+        size_t mark = overlay.mark();
+        if (genome[i])
+            overlay.apply_cleared(std::get<0>(suggested_links[i]), std::get<1>(suggested_links[i]), std::get<2>(suggested_links[i]));
+        double bound;
+        screen.passes_coverage(overlay, cost);
+        screen.load(suggested_links, genome);
+        screen.passes_hops(overlay, cost, bound);
+        screen.unload();
+        overlay.rollback(mark);
+        genome[i] = 0;
+    });
+
+    // The routes planned for a design that made it through the screen
+    PathScratch paths;
+    t_routes_and_scores routes;
+    measure("make_paths", suggested_links.size(), [&](size_t i) {
+        make_paths(link_spaces[i], supply_chain, model.resources, model, paths, routes);
+    });
+
+    // A month forecast of a race entrant, its pods scheduled beforehand
+    std::map<t_actions, t_routes_and_scores> candidates;
+    for (size_t i = 0; i < suggested_links.size(); i++)
+        candidates[{suggested_links[i]}] = make_paths(link_spaces[i], supply_chain, model.resources, model);
+    RaceForecaster forecaster(model, candidates);
+    std::vector<RaceEntry> entries;
+    for (const auto &[actions, routes]: candidates) {
+        entries.push_back({&actions, &routes});
+        forecaster.load(actions);
+        forecaster.schedule(entries.back());
+        forecaster.unload();
+    }
+    measure("race_forecast", entries.size(), [&](size_t i) {
+        forecaster.load(*entries[i].actions);
+        forecaster.forecast(entries[i], DAYS_PER_MONTH);
+        forecaster.unload();
+    });
+}
+
+static void run_config(const BenchConfig &cfg, int rounds, bool candidate_allocs) {
+    MapParams params;
+    params.seed = cfg.seed;
+    params.layout = cfg.layout;
+    params.buildings = cfg.buildings;
+    params.types = cfg.types;
+    params.min_astronauts = std::max(1, cfg.astronauts / 2);
+    params.max_astronauts = cfg.astronauts;
+    MapGenerator generator;
+    GameMap map = generator.generate(params);
+
+    SimModel model;
+    int resources = map.initial_resources;
+    std::string prefix = std::string(cfg.layout == CLUSTERED ? "clustered" : "uniform") + ","
+        + std::to_string(cfg.buildings) + "," + std::to_string(cfg.astronauts) + ","
+        + std::to_string(cfg.types) + "," + std::to_string(cfg.seed) + ",";
+
+    std::streambuf *real_cin = std::cin.rdbuf();
+    std::streambuf *real_cout = std::cout.rdbuf();
+    for (int round = 0; round < std::min(rounds, MAP_MONTHS); round++) {
+        if (round > 0)
+            resources += resources / 10 + map.monthly_income;
+        std::istringstream input(make_round_input(model, map, round, resources));
+        std::ostringstream output;
+        std::cin.rdbuf(input.rdbuf());
+        std::cin.clear();
+        model.parse_input();
+        reconcile_network(model);
+        std::cout.rdbuf(output.rdbuf());
+
+        PhaseCounter round_counter, phase;
+        auto report = [&](const char *name, const PhaseCounter &c, int score) {
+            std::cout.rdbuf(real_cout);
+            std::cout << prefix << round << "," << name << "," << c.elapsed_us() << ","
+                      << g_alloc_count.load() - c.allocs << "," << g_alloc_bytes.load() - c.bytes << "," << score << "\n";
+            std::cout.rdbuf(output.rdbuf());
+        };
+
+        auto supply_chain = check_dude_supply_chain(model);
+        if (!candidate_allocs) { report("check_dude_supply_chain", phase, 0); phase.reset(); }
+        auto suggested_links = suggest_links_for_supply_chain(model, supply_chain);
+        if (!candidate_allocs) { report("suggest_links_for_supply_chain", phase, 0); phase.reset(); }
+        if (candidate_allocs) {
+            std::cout.rdbuf(real_cout);
+            report_candidate_allocs(prefix, round, model, supply_chain, suggested_links);
+            std::cout.rdbuf(output.rdbuf());
+        }
+        auto result_routes_for_links = check_routes(model, supply_chain, suggested_links);
+        int score = predicted_score(result_routes_for_links);
+        if (!candidate_allocs) { report("check_routes", phase, score); phase.reset(); }
+        apply_best_routes(model, result_routes_for_links);
+        if (!candidate_allocs) {
+            report("apply_best_routes", phase, score);
+            report("round", round_counter, score);
+        }
+
+        std::cout.rdbuf(real_cout);
+        resources -= spent_on(output.str(), model);
+        resources = std::max(0, resources);
+    }
+    std::cin.rdbuf(real_cin);
+}
+
+int main(int argc, char **argv) {
+    std::vector<int> buildings = {3, 10, 25, 50, 100, 150};
+    std::vector<int> astronauts = {10, 100, 1000};
+    std::vector<int> types = {4, 10, 20};
+    std::vector<MapLayout> layouts = {UNIFORM, CLUSTERED};
+    int seeds = 3, rounds = MAP_MONTHS;
+    bool candidate_allocs = false;
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--candidate-allocs") { candidate_allocs = true; i--; continue; }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for: " << arg << std::endl;
+            return 1;
+        }
+        if (arg == "--buildings") buildings = parse_list(argv[i + 1]);
+        else if (arg == "--astronauts") astronauts = parse_list(argv[i + 1]);
+        else if (arg == "--types") types = parse_list(argv[i + 1]);
+        else if (arg == "--seeds") seeds = std::atoi(argv[i + 1]);
+        else if (arg == "--rounds") rounds = std::atoi(argv[i + 1]);
+        else if (arg == "--layouts") {
+            layouts.clear();
+            if (std::string(argv[i + 1]).find("uniform") != std::string::npos) layouts.push_back(UNIFORM);
+            if (std::string(argv[i + 1]).find("clustered") != std::string::npos) layouts.push_back(CLUSTERED);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    // The planner logs a lot, keep the CSV clean
+    NullBuffer null_buffer;
+    std::streambuf *real_cerr = std::cerr.rdbuf(&null_buffer);
+
+    if (candidate_allocs)
+        std::cout << "layout,buildings,astronauts,types,seed,round,kernel,candidates,allocs_per_candidate,bytes_per_candidate\n";
+    else
+        std::cout << "layout,buildings,astronauts,types,seed,round,phase,time_us,allocs,alloc_bytes,predicted_score\n";
+    for (MapLayout layout : layouts)
+        for (int b : buildings)
+            for (int a : astronauts)
+                for (int t : types)
+                    for (int seed = 0; seed < seeds; seed++)
+                        run_config({layout, b, a, t, (uint32_t)seed}, rounds, candidate_allocs);
+
+    std::cerr.rdbuf(real_cerr);
+    return 0;
+}
@@ -14,12 +14,35 @@
 #include <sstream>
 #include <tuple>
 #include <functional> // For std::hash
+#include <memory>
+#include <bitset>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <cstdlib>
+#include <climits>
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <utility> // For std::exchange
+#define JI_COROUTINES 1 // C++20 builds stream candidate sets from a coroutine
+#else
+#define JI_COROUTINES 0
+#endif
 
 #define LOGGING_PARSING false
+#define PONDERING true // Precompute geometry in a background thread while waiting for input
 #define EPSILON 0.01
 #define POD_PRICE 1000
 #define TUBE_PRICE 10
 #define TELEPORTER_PRICE 5000
+#define POD_REFUND 750
+#define MONTHLY_INTEREST_PERCENT 10 // Resources left grow by this much each month
+#ifndef TELEMETRY_FILE
+#define TELEMETRY_FILE "" // Also append the end of game accuracy report to this file when set
+#endif
 
 #define NOTHING_TO_DO 1
 #define SUCCESS 0
@@ -33,8 +56,22 @@
 #define T_TELE 2
 #define T_CITY 3
 #define T_PODS 4
+#define T_UPGR 5
 #define T_IMPOSSIBLE -1
 
+#define MAX_BUILDINGS 1024   // Building ids must stay below this to fit route bitsets
+#define MAX_ROUTE_DEPTH 4    // Hops explored away from a pad when building pod routes
+#define MAX_TELEPORTER_PLANS 4
+#define POD_CAPACITY 10
+#define DAYS_PER_MONTH 20
+#define MAX_PODS_PER_ROUTE 3
+#define MAX_TUBE_CAPACITY 3
+#define MAX_TUBES_PER_BUILDING 5
+#define MAP_MONTHS_LEFT(round) (20 - (round)) // Months paid out from this one on
+#define TURN_BUDGET_MS 400          // The referee allows 500 ms per turn
+#define FIRST_TURN_BUDGET_MS 900    // and 1000 ms for the first one
+#define ROUTE_SEARCH_RESERVE_MS 120 // Kept from the design search for the race and the route search
+
 class SimModel;
 class City;
 
@@ -55,6 +92,8 @@ typedef std::vector<std::tuple<City*, Hangout*, Flow> >  t_drains;
 typedef std::pair<t_sources, t_drains> t_DudeSupplyChain;
 typedef std::vector<std::tuple<Building*, Building*, int> > t_actions;
 typedef std::vector<int> t_route;
+typedef std::set<std::tuple<int, int, int> > t_design; // Links of a network design {(b1 id, b2 id, link_type)}
+typedef std::bitset<MAX_BUILDINGS> t_visited;
 
 // ██    ██ ████████ ██ ██      ███████
 // ██    ██    ██    ██ ██      ██
@@ -81,6 +120,75 @@ void    debug_time(int x) {
         std::cerr << "Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count() << "ms" << std::endl;
 }
 
+/**
+ * Vector with room for N elements inline, it only goes to the heap past that
+ * Meant for the short lists the planner builds and drops in its inner loops
+ */
+template <typename T, size_t N>
+class SmallVector {
+    T               inline_items[N];
+    std::vector<T>  heap;
+    size_t          count = 0;
+    bool            spilled = false;
+
+public:
+    void push_back(const T &item) {
+        if (!spilled && count < N) {
+            inline_items[count++] = item;
+            return;
+        }
+        if (!spilled) {
+            heap.assign(inline_items, inline_items + count);
+            spilled = true;
+        }
+        heap.push_back(item);
+        count++;
+    }
+    void pop_back() {
+        count--;
+        if (spilled)
+            heap.pop_back();
+    }
+    void clear() { count = 0; spilled = false; heap.clear(); }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T *data() { return spilled ? heap.data() : inline_items; }
+    const T *data() const { return spilled ? heap.data() : inline_items; }
+    T &operator[](size_t i) { return data()[i]; }
+    const T &operator[](size_t i) const { return data()[i]; }
+    T &back() { return data()[count - 1]; }
+
+    T *begin() { return data(); }
+    T *end() { return data() + count; }
+    const T *begin() const { return data(); }
+    const T *end() const { return data() + count; }
+    std::reverse_iterator<const T*> rbegin() const { return std::reverse_iterator<const T*>(end()); }
+    std::reverse_iterator<const T*> rend() const { return std::reverse_iterator<const T*>(begin()); }
+};
+
+/**
+ * Set stored as a sorted vector: no node per element, and clear() keeps the memory
+ */
+template <typename T>
+class FlatSet {
+    std::vector<T>  items;
+
+public:
+    bool insert(const T &item) {
+        auto it = std::lower_bound(items.begin(), items.end(), item);
+        if (it != items.end() && *it == item)
+            return false;
+        items.insert(it, item);
+        return true;
+    }
+    size_t count(const T &item) const { return std::binary_search(items.begin(), items.end(), item) ? 1 : 0; }
+    void clear() { items.clear(); }
+    size_t size() const { return items.size(); }
+    typename std::vector<T>::const_iterator begin() const { return items.begin(); }
+    typename std::vector<T>::const_iterator end() const { return items.end(); }
+};
+
 class Flow
 {
     /**
@@ -96,6 +204,8 @@ public:
 
     Flow() {}
 
+    Flow(const Flow&) = default;
+
     Flow(int type) {
         data[type] = -1.0;
     }
@@ -175,12 +285,9 @@ public:
         for (const auto& [type, count]: hangouts_type) {
             if (overflow.data.find(type) == overflow.data.end()) {
                 overflow.data[type] = -count; // Actually an underflow
-            } else {
-                // Put a ratio of In-flow over Out-flow
-                // Add 10,000 as magic value (Natural values will never be that high)
-                // So we can later catch these large values and know they are balance-ratios and not an overflow
-                if (count != 0)
-                    overflow.data[type] = (overflow.data[type]) + 10000;
+            } else if (count != 0) {
+                // Served type: astronauts each of its hangouts gets per month, BalanceModel scores it
+                overflow.data[type] = overflow.data[type] / count;
             }
         }
         return overflow;
@@ -195,6 +302,69 @@ void log(const std::string& message) {
     std::cerr << message << std::endl;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// PLANNER PARAMETERS
+
+/**
+ * Tunable weights of the planner: X(type, name, default, lowest, highest, what it does)
+ * The range is where tune.cpp searches, the bot itself takes any value.
+ */
+#define PLANNER_PARAMS(X) \
+    X(int,    route_top_weight,         5,    1,   10,  "Score of a matching module next to the pad in a pod route") \
+    X(int,    route_hop_penalty,        1,    0,   3,   "Score lost per extra hop away from the pad") \
+    X(int,    sample_width_limit,       20,   4,   40,  "Draws wider than this are cut down to sample_width_cap") \
+    X(int,    sample_width_cap,         15,   4,   40,  "Links drawn per candidate set once the limit is hit") \
+    X(int,    min_draws,                8,    2,   20,  "Candidate sets drawn per turn, at least") \
+    X(double, unserved_tube_pod_share,  1.0,  0.0, 2.0, "Share of a pod's price charged to a tube no pod serves yet") \
+    X(double, resource_interest_weight, 1.0,  0.0, 2.0, "How many months of interest a resource kept is worth, per month left") \
+    X(double, bandit_exploration,       1.0,  0.0, 3.0, "UCB exploration bonus of the link families") \
+    X(int,    upgrade_min_gained_moves, 10,   0,   40,  "Pod moves per month an upgrade must unlock")
+
+struct PlannerParams {
+#define X(type, name, value, lowest, highest, doc) type name = value;
+    PLANNER_PARAMS(X)
+#undef X
+
+    // Returns false if there is no such parameter
+    bool set(const std::string &key, double value) {
+#define X(type, name, def, lowest, highest, doc) if (key == #name) { name = (type)value; return true; }
+        PLANNER_PARAMS(X)
+#undef X
+        return false;
+    }
+
+    // "name=value,name=value", unknown names are logged and skipped
+    void parse(const std::string &text) {
+        std::stringstream ss(text);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            size_t eq = item.find('=');
+            if (eq == std::string::npos || !set(item.substr(0, eq), std::atof(item.c_str() + eq + 1)))
+                log("Unknown planner parameter: " + item);
+        }
+    }
+
+    std::string to_string() const {
+        std::ostringstream ss;
+        const char *sep = "";
+#define X(type, name, def, lowest, highest, doc) ss << sep << #name << "=" << name; sep = ",";
+        PLANNER_PARAMS(X)
+#undef X
+        return ss.str();
+    }
+};
+
+// Defaults, overridden by the JI_PARAMS environment variable ("name=value,...")
+const PlannerParams &params() {
+    static const PlannerParams loaded = []() {
+        PlannerParams p;
+        if (const char *env = std::getenv("JI_PARAMS"))
+            p.parse(env);
+        return p;
+    }();
+    return loaded;
+}
+
 const std::string &error_strings(int e) {
     static std::map<int, std::string> error_strings;
 
@@ -284,6 +454,237 @@ void close_round() {
 enum TeleporterState { Frei, Eingang, Ausgang };
 enum BuildingClass { PAD, HANGOUT };
 
+#define UNREACHABLE_DISTANCE (1 << 20)
+
+/**
+ * Hop distance from every building of a city to its nearest hangout of each type
+ *
+ * This is what astronauts follow: they head for the nearest module of their type,
+ * tubes cost one day each way, teleporters are free but one-way (entrance -> exit).
+ * One flat array per type indexed by building id, filled by a multi-source 0-1 BFS
+ * from the hangouts, and only ever relaxed since networks never lose a link.
+ * The links are kept by building id too, so trials and assignments between fields of the
+ * same network do not allocate.
+ */
+class DistanceField {
+    std::map<int, std::vector<int>>     by_type;            // {type: distance by building id}
+    std::vector<std::vector<int>>       tube_neighbors = std::vector<std::vector<int>>(MAX_BUILDINGS);  // By building id
+    std::vector<std::vector<int>>       tp_entrances_of = std::vector<std::vector<int>>(MAX_BUILDINGS); // By exit id
+    std::vector<int>                    tp_exit_of = std::vector<int>(MAX_BUILDINGS, -1);               // By entrance id
+    std::vector<int>                    wave, next_wave;    // Scratch of relax_from, kept by assignment
+    bool                                in_trial = false;
+    std::vector<std::tuple<std::vector<int>*, int, int>> lowered; // (distances, building id, before) since begin_trial
+    std::vector<std::tuple<int, int, int>> linked;          // (link type, id1, id2) since begin_trial
+
+    void lower(std::vector<int> &dist, int id, int value) {
+        if (in_trial)
+            lowered.push_back({&dist, id, dist[id]});
+        dist[id] = value;
+    }
+
+    /**
+     * Propagate a decrease of dist[from] backwards through the network
+     * Level by level from dist[from]: teleporter entrances join the level being searched,
+     * tube neighbours the next one
+     */
+    void relax_from(std::vector<int> &dist, int from) {
+        if (wave.capacity() < MAX_BUILDINGS) { // The two buffers swap, both get room for every building
+            wave.reserve(MAX_BUILDINGS);
+            next_wave.reserve(MAX_BUILDINGS);
+        }
+        wave.clear();
+        wave.push_back(from);
+        for (int d = dist[from]; !wave.empty(); d++) {
+            next_wave.clear();
+            for (size_t i = 0; i < wave.size(); i++) {
+                int current = wave[i];
+                if (dist[current] != d)
+                    continue;
+                for (int entrance: tp_entrances_of[current]) {
+                    if (d < dist[entrance]) {
+                        lower(dist, entrance, d);
+                        wave.push_back(entrance);
+                    }
+                }
+                for (int neighbor: tube_neighbors[current]) {
+                    if (d + 1 < dist[neighbor]) {
+                        lower(dist, neighbor, d + 1);
+                        next_wave.push_back(neighbor);
+                    }
+                }
+            }
+            std::swap(wave, next_wave);
+        }
+    }
+
+    // Copy of `from` in `to`, the vectors of the keys both have keep their memory
+    static void assign_reusing(std::map<int, std::vector<int>> &to, const std::map<int, std::vector<int>> &from) {
+        for (auto it = to.begin(); it != to.end();)
+            it = from.count(it->first) ? std::next(it) : to.erase(it);
+        for (const auto &[key, values]: from)
+            to[key].assign(values.begin(), values.end());
+    }
+
+    static void assign_reusing(std::vector<std::vector<int>> &to, const std::vector<std::vector<int>> &from) {
+        to.resize(from.size());
+        for (size_t i = 0; i < from.size(); i++)
+            to[i].assign(from[i].begin(), from[i].end());
+    }
+
+public:
+    /**
+     * Become a copy of `other` without allocating when it has the same types and buildings
+     * (map assignment rebuilds every vector, this one refills them)
+     */
+    void assign(const DistanceField &other) {
+        assign_reusing(by_type, other.by_type);
+        assign_reusing(tube_neighbors, other.tube_neighbors);
+        assign_reusing(tp_entrances_of, other.tp_entrances_of);
+        tp_exit_of.assign(other.tp_exit_of.begin(), other.tp_exit_of.end());
+    }
+
+    void add_hangout(int building_id, int type) {
+        auto [it, inserted] = by_type.try_emplace(type, MAX_BUILDINGS, UNREACHABLE_DISTANCE);
+        std::vector<int> &dist = it->second;
+        if (dist[building_id] == 0)
+            return;
+        dist[building_id] = 0;
+        relax_from(dist, building_id);
+    }
+
+    void add_tube(int id1, int id2) {
+        if (in_trial)
+            linked.push_back({T_TUBE, id1, id2});
+        tube_neighbors[id1].push_back(id2);
+        tube_neighbors[id2].push_back(id1);
+        for (auto &[type, dist]: by_type) {
+            if (dist[id1] + 1 < dist[id2]) { lower(dist, id2, dist[id1] + 1); relax_from(dist, id2); }
+            if (dist[id2] + 1 < dist[id1]) { lower(dist, id1, dist[id2] + 1); relax_from(dist, id1); }
+        }
+    }
+
+    void add_teleporter(int entrance, int exit) {
+        if (in_trial)
+            linked.push_back({T_TELE, entrance, exit});
+        tp_entrances_of[exit].push_back(entrance);
+        tp_exit_of[entrance] = exit;
+        for (auto &[type, dist]: by_type) {
+            if (dist[exit] < dist[entrance]) { lower(dist, entrance, dist[exit]); relax_from(dist, entrance); }
+        }
+    }
+
+    /**
+     * Links added from now on are recorded, end_trial() takes them all back
+     * A trial costs what it changes instead of a copy of the field. Hangouts cannot be added meanwhile.
+     */
+    void begin_trial() {
+        in_trial = true;
+    }
+
+    void end_trial() {
+        for (auto it = lowered.rbegin(); it != lowered.rend(); ++it) {
+            const auto &[dist, id, before] = *it;
+            (*dist)[id] = before;
+        }
+        for (auto it = linked.rbegin(); it != linked.rend(); ++it) {
+            const auto &[link_type, id1, id2] = *it;
+            if (link_type == T_TUBE) {
+                tube_neighbors[id1].pop_back();
+                tube_neighbors[id2].pop_back();
+            } else {
+                tp_entrances_of[id2].pop_back();
+                tp_exit_of[id1] = -1;
+            }
+        }
+        lowered.clear();
+        linked.clear();
+        in_trial = false;
+    }
+
+    // Hops (days of travel) from a building to the nearest hangout of `type`, UNREACHABLE_DISTANCE if none
+    int distance(int type, int building_id) const {
+        auto it = by_type.find(type);
+        if (it == by_type.end() || building_id < 0 || building_id >= MAX_BUILDINGS)
+            return UNREACHABLE_DISTANCE;
+        return it->second[building_id];
+    }
+
+    // Distances to `type` by building id, nullptr if no hangout of that type was added
+    const std::vector<int> *distances(int type) const {
+        auto it = by_type.find(type);
+        return it == by_type.end() ? nullptr : &it->second;
+    }
+
+    // Expected day of arrival if a pod was always waiting, O(1)
+    int arrival_day(int type, int building_id) const {
+        return distance(type, building_id);
+    }
+
+    /**
+     * Where an astronaut of `type` standing on `building_id` tries to go next
+     * Teleporters first (taken if the exit is not farther), then the tube neighbour
+     * with the smallest id amongst those strictly closer. Returns -1 if stuck or arrived.
+     */
+    int next_hop(int type, int building_id) const {
+        int here = distance(type, building_id);
+        if (here == 0 || here >= UNREACHABLE_DISTANCE)
+            return -1;
+        int exit = tp_exit_of[building_id];
+        if (exit >= 0 && distance(type, exit) <= here)
+            return exit;
+        int best = -1;
+        for (int neighbor: tube_neighbors[building_id])
+            if (distance(type, neighbor) < here && (best == -1 || neighbor < best))
+                best = neighbor;
+        return best;
+    }
+
+    // Forward hop count from `src` to every building (teleporters are free), UNREACHABLE_DISTANCE if not connected
+    void hops_from(int src, std::vector<int> &out) const {
+        std::vector<int> level, next_level;
+        hops_from(src, out, level, next_level);
+    }
+
+    // Same, searching level by level in the caller's buffers so repeated calls do not allocate
+    void hops_from(int src, std::vector<int> &out, std::vector<int> &level, std::vector<int> &next_level) const {
+        out.assign(MAX_BUILDINGS, UNREACHABLE_DISTANCE);
+        level.clear();
+        out[src] = 0;
+        level.push_back(src);
+        for (int hops = 0; !level.empty(); hops++) {
+            next_level.clear();
+            // Teleporter exits join the level being searched, tube neighbours the next one
+            for (size_t i = 0; i < level.size(); i++) {
+                int current = level[i];
+                if (out[current] != hops)
+                    continue;
+                int exit = tp_exit_of[current];
+                if (exit >= 0 && hops < out[exit]) {
+                    out[exit] = hops;
+                    level.push_back(exit);
+                }
+                for (int neighbor: tube_neighbors[current]) {
+                    if (hops + 1 < out[neighbor]) {
+                        out[neighbor] = hops + 1;
+                        next_level.push_back(neighbor);
+                    }
+                }
+            }
+            std::swap(level, next_level);
+        }
+    }
+
+    int teleporter_exit(int entrance) const {
+        return entrance >= 0 && entrance < MAX_BUILDINGS ? tp_exit_of[entrance] : -1;
+    }
+
+    bool has_teleporter(int entrance, int exit) const {
+        return teleporter_exit(entrance) == exit && exit >= 0;
+    }
+
+    const std::map<int, std::vector<int>> &fields() const { return by_type; }
+};
+
 /****** CITY *******/
 class City {
 public:
@@ -296,6 +697,7 @@ public:
     std::map<int, std::vector<int>> adjency_list;  // Adjacency list for buildings
     Flow                            dudes;  // City dude register {dude_type: population}
     std::map<int, int>              hangouts_types;
+    DistanceField                   distances;  // Per type distance to the nearest hangout
 
     // Constructor
     City() {}
@@ -317,7 +719,8 @@ public:
         return dudes;
     }
 
-    std::vector<Building *> find_closest_buildings(const Point &pad_pos, const Flow& flow) const;
+    // (closest hangout of a type in `flow`, closest hangout), either may be null
+    std::array<Building *, 2> find_closest_buildings(const Point &pad_pos, const Flow& flow) const;
 
     //TODO
     //std::tuple<Building*, Building*, int > biggest_graph_distance() const; // Return the two buildings with the biggest distance between them
@@ -483,6 +886,16 @@ public:
     Pod(t_route route) : id(pod_id_gen), route(route) {
         pod_id_gen++;
     }
+
+    // A pod the referee reported, ids we hand out later must not collide with it
+    Pod(int id, t_route route) : id(id), route(route) {
+        pod_id_gen = std::max(pod_id_gen, id + 1);
+    }
+
+    // Id the next pod will get
+    static int next_id() {
+        return pod_id_gen;
+    }
 };
 
 int Pod::pod_id_gen = 0;
@@ -548,6 +961,8 @@ void City::add_building(Building* building)
             hangouts_types[building->type] = 1;
         else
             hangouts_types[building->type] += 1;
+        if (building->id < MAX_BUILDINGS)
+            distances.add_hangout(building->id, building->type);
     } else if (building->building_class == BuildingClass::PAD)
     {
         landing_pads[building->id] = dynamic_cast<LandingPad*>(building);
@@ -567,6 +982,13 @@ void City::add_link(Link* link) {
         teleporters[link->id] = link;  // Add to teleporters if capacity is 0 (unlimited)
     else
         tubes[link->id] = link;  // Add to tubes otherwise
+
+    if (link->b1->id < MAX_BUILDINGS && link->b2->id < MAX_BUILDINGS) {
+        if (link->capacity == 0)
+            distances.add_teleporter(link->b1->id, link->b2->id);
+        else
+            distances.add_tube(link->b1->id, link->b2->id);
+    }
 }
 
 // Add a pod to the city
@@ -591,7 +1013,7 @@ void City::merge_city(const City& other)
     for (const auto& [id, pod] : other.pods) {
         add_pod(pod);
     }
-    this->dudes = this->dudes + other.dudes;
+    // add_building already counted the dudes of the other city's pads
 }
 
 int City::has_type_outflow(int type) const {
@@ -605,10 +1027,8 @@ int City::has_type_inflow(int type) const {
     return dudes.get_type_count(type);
 }
 
-std::vector<Building *> City::find_closest_buildings(const Point &pad_pos, const Flow& flow) const
+std::array<Building *, 2> City::find_closest_buildings(const Point &pad_pos, const Flow& flow) const
 {
-    std::vector<Building *> result;
-
     Hangout *closest_matching_hangout = nullptr;
     double closest_matching_distance = std::numeric_limits<double>::max();
 
@@ -628,14 +1048,6 @@ std::vector<Building *> City::find_closest_buildings(const Point &pad_pos, const
             closest_universal = hangout;
         }
     }
-
-    for (const auto& [id, hangout]: hangouts) {
-        double distance = pad_pos.distance(hangout->get_pos());
-        if (distance < closest_universal_distance) {
-            closest_universal_distance = distance;
-            closest_universal = hangout;
-        }
-    }
     return {closest_matching_hangout, closest_universal};
 }
 
@@ -645,6 +1057,300 @@ std::vector<Building *> City::find_closest_buildings(const Point &pad_pos, const
 // ██  ██  ██ ██    ██ ██   ██ ██      ██
 // ██      ██  ██████  ██████  ███████ ███████
 
+/**
+ * Geometry precomputed by the Ponderer between two turns
+ * Indexed densely, `index_of` maps a building id to its row
+ * Only ever read by the main thread once handed over
+ */
+struct PonderResult {
+    int                 round;
+    int                 tube_id_watermark;  // Tubes with a smaller id were part of the snapshot
+    std::vector<int>    ids;
+    std::map<int, int>  index_of;
+    std::vector<char>   tube_feasible;      // n*n, -1 not computed yet, 0 impossible, 1 possible at snapshot time
+    std::vector<const Building*>  unseen_buildings; // Filled by the main thread: buildings the snapshot did not know
+
+    size_t size() const { return ids.size(); }
+
+    int index(int building_id) const {
+        auto it = index_of.find(building_id);
+        return it == index_of.end() ? -1 : it->second;
+    }
+
+    int feasible(int id1, int id2) const {
+        int i = index(id1), j = index(id2);
+        if (i < 0 || j < 0)
+            return -1;
+        return tube_feasible[i * size() + j];
+    }
+};
+
+// Tubes are two-way, both directions share one key
+inline std::pair<int, int> tube_key(int id1, int id2) {
+    return id1 < id2 ? std::make_pair(id1, id2) : std::make_pair(id2, id1);
+}
+
+enum LinkCategory {
+    CAT_PAD_TO_MATCH,   // Pad to a hangout of one of its types
+    CAT_PAD_TO_OTHER,   // Pad to anything else (a Steiner point)
+    CAT_CITY_MERGE,     // Between two cities
+    CAT_CITY_EXTEND,    // A stray hangout into a city, or between stray hangouts
+    CAT_TELEPORTER,
+    CAT_COUNT
+};
+
+#define BANDIT_LONG_LINK_KM 20  // Arms split candidates on their length too
+#define BANDIT_ARMS (CAT_COUNT * 2)
+#define BANDIT_WARMUP_PULLS 40  // Draws per turn drop once the arms have this much history
+
+/**
+ * UCB1 over candidate link families (category x short/long), kept across turns
+ * Rewards are in [0, 1]: the share of the turn's best route score gain a draw holding the link reached
+ */
+class LinkBandit {
+    std::vector<double> total = std::vector<double>(BANDIT_ARMS, 0);
+    std::vector<int>    pulls = std::vector<int>(BANDIT_ARMS, 0);
+    int                 all_pulls = 0;
+
+public:
+    static int arm(int category, double length) {
+        return category * 2 + (length > BANDIT_LONG_LINK_KM);
+    }
+
+    double ucb(int arm) const {
+        if (pulls[arm] == 0)
+            return 1.0 + params().bandit_exploration; // Untried arms first
+        return total[arm] / pulls[arm] + params().bandit_exploration * std::sqrt(std::log((double)all_pulls + 1) / pulls[arm]);
+    }
+
+    void reward(int arm, double value) {
+        total[arm] += value;
+        pulls[arm]++;
+        all_pulls++;
+    }
+
+    int history() const { return all_pulls; }
+
+    std::string to_string() const {
+        std::string result = "Bandit:";
+        for (int a = 0; a < BANDIT_ARMS; a++)
+            if (pulls[a])
+                result += " " + std::to_string(a) + "=" + std::to_string(total[a] / pulls[a]).substr(0, 4) + "/" + std::to_string(pulls[a]);
+        return result;
+    }
+};
+
+// A link as the referee reported it, capacity 0 for teleporters (b1 is the entrance)
+struct ReportedLink {
+    int b1, b2, capacity;
+};
+
+enum SupplyEvent { BUILDING_ARRIVED, LINK_BUILT, CITIES_MERGED, CITIES_REBUILT, WAVE_EMITTED };
+
+struct SupplyChange {
+    SupplyEvent event;
+    City*       city;           // City affected (the one kept by a merge), nullptr for stray buildings
+    int         building_id;    // Building involved, -1 if none
+    const City* absorbed;       // City merged into `city` and deleted, nullptr for other events
+};
+
+/**
+ * Sources and drains kept up to date from network events instead of rebuilt every round
+ *
+ * Stray pads and hangouts are cast once, when they arrive. City overflows are only
+ * recomputed for the cities a link or a merge touched since they were last asked for.
+ * Subscribers hear about every change as it happens, `changes()` only lists those since
+ * begin_round(): parse_input calls it, so the links built last turn are not in it.
+ */
+class SupplyChainTracker {
+    std::map<int, LandingPad*>              stray_pads;
+    std::map<int, Hangout*>                 stray_hangouts;
+    std::map<City*, Flow>                   overflow_of;
+    std::set<City*>                         dirty;
+    std::vector<SupplyChange>               round_changes;
+    std::vector<std::function<void(const SupplyChange&)>> subscribers;
+
+    void notify(const SupplyChange &change) {
+        round_changes.push_back(change);
+        for (const auto &subscriber: subscribers)
+            subscriber(change);
+    }
+
+    void leave_strays(const Building *b) {
+        stray_pads.erase(b->id);
+        stray_hangouts.erase(b->id);
+    }
+
+public:
+    void subscribe(std::function<void(const SupplyChange&)> subscriber) {
+        subscribers.push_back(std::move(subscriber));
+    }
+
+    void on_building_arrived(Building *building) {
+        if (building->building_class == BuildingClass::PAD)
+            stray_pads[building->id] = dynamic_cast<LandingPad*>(building);
+        else
+            stray_hangouts[building->id] = dynamic_cast<Hangout*>(building);
+        notify({BUILDING_ARRIVED, nullptr, building->id, nullptr});
+    }
+
+    void on_link_built(const Link *link) {
+        leave_strays(link->b1);
+        leave_strays(link->b2);
+        dirty.insert(link->city);
+        notify({LINK_BUILT, link->city, link->b1->id, nullptr});
+    }
+
+    void on_cities_merged(City *kept, City *absorbed) {
+        overflow_of.erase(absorbed);
+        dirty.erase(absorbed);
+        dirty.insert(kept);
+        notify({CITIES_MERGED, kept, -1, absorbed});
+    }
+
+    // A pad sends its first wave the month it arrives, the next ones repeat it and are not reported
+    void on_wave_emitted(const LandingPad *pad) {
+        notify({WAVE_EMITTED, pad->city, pad->id, nullptr});
+    }
+
+    // Start over from the buildings, for when cities were regrouped from scratch
+    void resync(const std::map<int, Building*> &buildings) {
+        stray_pads.clear();
+        stray_hangouts.clear();
+        overflow_of.clear();
+        dirty.clear();
+        for (const auto &[id, building]: buildings) {
+            if (building->city != nullptr)
+                dirty.insert(building->city);
+            else if (building->building_class == BuildingClass::PAD)
+                stray_pads[id] = dynamic_cast<LandingPad*>(building);
+            else
+                stray_hangouts[id] = dynamic_cast<Hangout*>(building);
+        }
+        notify({CITIES_REBUILT, nullptr, -1, nullptr});
+    }
+
+    void begin_round() {
+        round_changes.clear();
+    }
+
+    const std::vector<SupplyChange> &changes() const { return round_changes; }
+
+    /**
+     * Cities are both a source and a drain (their overflow), stray pads are sources,
+     * stray hangouts are drains. Cities come in the order of `cities`.
+     */
+    t_DudeSupplyChain supply_chain(const std::vector<City*> &cities) {
+        for (City *city: dirty)
+            overflow_of[city] = Flow::get_overflow(city->dudes, city->hangouts_types);
+        dirty.clear();
+
+        t_DudeSupplyChain supply_chain;
+        for (City *city: cities) {
+            const Flow &overflow = overflow_of[city];
+            supply_chain.first.push_back(std::make_tuple(city, nullptr, overflow));
+            supply_chain.second.push_back(std::make_tuple(city, nullptr, overflow));
+        }
+        for (const auto &[id, pad]: stray_pads)
+            supply_chain.first.push_back(std::make_tuple(nullptr, pad, pad->dudes));
+        for (const auto &[id, hangout]: stray_hangouts)
+            supply_chain.second.push_back(std::make_tuple(nullptr, hangout, Flow(hangout->type)));
+        return supply_chain;
+    }
+};
+
+// Buildings of one drain a source at `pos` could link to, appended to `out`
+void buildings_to_drain(std::vector<Building*> &out, const t_drains::value_type &drain, const Point &pos, const Flow &src_flow)
+{
+    const auto &[drain_city, drain_hangout, flow] = drain;
+    if (drain_city) {
+        for (auto building : drain_city->find_closest_buildings(pos, src_flow)) {
+            if (building != nullptr)
+                out.push_back(building);
+        }
+    }
+    else { // If the drain is a hangout
+        if (flow.has_type(drain_hangout->type)) {
+            out.push_back(drain_hangout);
+            if (LOGGING_PARSING)
+                log("Hangout matching: " + std::to_string(drain_hangout->id) + " Sourceflow: " + src_flow.to_string());
+        }
+        else {
+            if (LOGGING_PARSING)
+                log("Hangout not matching: " + std::to_string(drain_hangout->id) + " Sourceflow: " + src_flow.to_string());
+        }
+    }
+}
+
+/**
+ * What get_best_drains_for_source finds for a city, kept across rounds by (source city, drain)
+ *
+ * Fed by the supply chain changes: a link or a merge drops the pairs of the cities it touched
+ * (and of the absorbed one, whose address a new city may reuse), a rebuild drops them all.
+ * New buildings and waves change no pair, a new stray hangout is just a pair not asked for yet.
+ */
+class DrainCache {
+    // One row per pad of the source city, in the order of its landing_pads
+    std::map<std::pair<const City*, const void*>, std::vector<std::vector<Building*>>> rows_of;
+    long long hits = 0, misses = 0;
+
+    void drop(const City *city) {
+        for (auto it = rows_of.begin(); it != rows_of.end();)
+            it = it->first.first == city || it->first.second == city ? rows_of.erase(it) : std::next(it);
+    }
+
+public:
+    void on_change(const SupplyChange &change) {
+        switch (change.event) {
+            case LINK_BUILT:
+                drop(change.city);
+                break;
+            case CITIES_MERGED:
+                drop(change.city);
+                drop(change.absorbed);
+                break;
+            case CITIES_REBUILT:
+                rows_of.clear();
+                break;
+            case BUILDING_ARRIVED:
+            case WAVE_EMITTED:
+                break;
+        }
+    }
+
+    // Same buildings in the same order as get_best_drains_for_source(source, nullptr, drains)
+    std::vector<Building*> best_drains(const City *source, const t_drains &drains) {
+        std::vector<const std::vector<std::vector<Building*>>*> pairs;
+        for (const auto &drain: drains) {
+            const City *drain_city = std::get<0>(drain);
+            if (drain_city == source)
+                continue;
+            const void *key = drain_city != nullptr ? (const void*)drain_city : (const void*)std::get<1>(drain);
+            auto [it, fresh] = rows_of.try_emplace({source, key});
+            if (fresh) {
+                for (const auto &[id, pad]: source->landing_pads) {
+                    it->second.emplace_back();
+                    buildings_to_drain(it->second.back(), drain, pad->get_pos(), source->get_dudes());
+                }
+            }
+            fresh ? misses++ : hits++;
+            pairs.push_back(&it->second);
+        }
+        std::vector<Building*> buildings;
+        for (size_t row = 0; row < source->landing_pads.size(); row++)
+            for (const auto *rows: pairs)
+                buildings.insert(buildings.end(), (*rows)[row].begin(), (*rows)[row].end());
+        return buildings;
+    }
+
+    // Pairs reused and computed since the last call
+    std::pair<long long, long long> take_counts() {
+        std::pair<long long, long long> counts = {hits, misses};
+        hits = misses = 0;
+        return counts;
+    }
+};
+
 class UniqueFIFOQueue {
     // Implementing a unique FIFO queue, similar to what you have in Python
     std::queue<int> queue;
@@ -686,19 +1392,54 @@ public:
     std::map<int, Building*> buildings; // {id: Building*}
 
     // Routes
-    std::map<int, std::vector<std::pair<int, int>>> routes; // {id: {neighbor_id, capacity}}
+    std::map<int, std::vector<std::pair<int, int>>> routes; // {id: {neighbor_id, capacity}}, as reported this round
     std::map<int, Tube*> tubes;  // {id: Tube*}
     std::map<int, Teleporter*> teleporters; // {id: Teleporter*}
     std::map<int, Pod*> pods; // {id: Pod*}
     std::map<int, Tube*> dead_tubes; // Tubes not being used in current routes
+    std::map<std::pair<int, int>, Tube*> tubes_by_ends; // {(min id, max id): Tube*}
+    std::map<int, Teleporter*> teleporters_by_entrance; // {entrance id: Teleporter*}
+    std::map<int, int> tube_count; // {building id: tubes ending there}
+
+    // Network state as the referee sent it this round, reconcile_network() syncs the model to it
+    std::vector<ReportedLink> reported_links;
+    std::map<int, t_route> reported_pods; // {id: stops}
+
+    // Geometry precomputed while we were waiting for this turn, may be null
+    std::unique_ptr<PonderResult> pondered;
+
+    // Cached sources and drains, kept up to date by parse_input and connect_buildings
+    SupplyChainTracker supply;
+
+    // Drains of each city, dropped as the supply chain reports the cities changed
+    DrainCache drains;
+
+    // Which candidate families paid off so far, biases sample_links
+    LinkBandit bandit;
+
+    // Everything planned this turn must be printed by then
+    std::chrono::steady_clock::time_point turn_deadline;
+
+    // Best network designs of the last search, they seed the next one
+    std::vector<t_design> design_pool;
+
+    // Monthly gain of the teleporters proposed this turn {(entrance, exit): points}
+    std::map<std::pair<int, int>, int> teleporter_gains;
 
     // Constructor
-    SimModel() : round(-1), resources(0) {}
+    SimModel() : round(-1), resources(0) {
+        supply.subscribe([this](const SupplyChange &change) { drains.on_change(change); });
+    }
 
-    // Parse input method
-    void parse_input() {
+    // Parse input method, returns false once the referee closed the input
+    bool parse_input() {
+        if (!(std::cin >> resources))
+            return false;
         round++;
-        std::cin >> resources; std::cin.ignore();
+        turn_deadline = std::chrono::steady_clock::now()
+            + std::chrono::milliseconds(round == 0 ? FIRST_TURN_BUDGET_MS : TURN_BUDGET_MS);
+        std::cin.ignore();
+        supply.begin_round();
 
         if (LOGGING_PARSING) {
             log("Resources: " + std::to_string(resources));
@@ -706,22 +1447,33 @@ public:
 
         int num_travel_routes;
         std::cin >> num_travel_routes; std::cin.ignore();
+        routes.clear();
+        reported_links.clear();
         for (int i = 0; i < num_travel_routes; ++i) {
             int building_id_1, building_id_2, capacity;
             std::cin >> building_id_1 >> building_id_2 >> capacity; std::cin.ignore();
 
             routes[building_id_1].emplace_back(building_id_2, capacity);
             routes[building_id_2].emplace_back(building_id_1, capacity);
+            reported_links.push_back({building_id_1, building_id_2, capacity});
         }
 
         int num_pods;
         std::cin >> num_pods; std::cin.ignore();
+        reported_pods.clear();
         for (int i = 0; i < num_pods; i++) {
             std::string pod_properties;
             std::getline(std::cin, pod_properties);
             if (LOGGING_PARSING) {
                 log("Pod properties: " + pod_properties);
             }
+
+            // id, number of stops, stops
+            std::istringstream ss(pod_properties);
+            std::vector<int> data((std::istream_iterator<int>(ss)), std::istream_iterator<int>());
+            if (data.size() < 2)
+                continue;
+            reported_pods[data[0]] = t_route(data.begin() + 2, data.begin() + std::min(data.size(), (size_t)data[1] + 2));
         }
 
         int num_new_buildings;
@@ -745,6 +1497,10 @@ public:
                 isolated_hangouts.insert(data[1]);
             }
 
+            supply.on_building_arrived(buildings[data[1]]);
+            if (data[0] == 0)
+                supply.on_wave_emitted(static_cast<LandingPad*>(buildings[data[1]]));
+
             if (LOGGING_PARSING) {
                 log(buildings[data[1]]->to_string());
             }
@@ -753,6 +1509,7 @@ public:
         if (LOGGING_PARSING) {
             log("New buildings: " + std::to_string(num_new_buildings));
         }
+        return true;
     }
 
     // Clean isolated buildings
@@ -778,6 +1535,11 @@ public:
         }
     }
 
+    int tubes_at(int building_id) const {
+        auto it = tube_count.find(building_id);
+        return it == tube_count.end() ? 0 : it->second;
+    }
+
     std::vector<Link *>    get_all_links() const {
         std::vector<Link *> links;
         for (const auto& [id, tube]: tubes) {
@@ -795,6 +1557,25 @@ public:
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
+// Exact prices, as the referee bills them: a tube costs 1 per 0.1 km, rounded down
+int tube_cost(const Building *b1, const Building *b2) {
+    return (int)std::floor(b1->get_pos().distance(b2->get_pos()) * TUBE_PRICE);
+}
+
+int upgrade_cost(const Link *tube) {
+    return tube_cost(tube->b1, tube->b2) * (tube->capacity + 1);
+}
+
+int action_cost(const Building *b1, const Building *b2, int link_type) {
+    if (link_type == T_TUBE)
+        return tube_cost(b1, b2);
+    if (link_type == T_TELE)
+        return TELEPORTER_PRICE;
+    if (link_type == T_PODS)
+        return POD_PRICE;
+    return 0;
+}
+
 bool teleporter_isvalid(Building *b1, Building *b2) {
     if (b1 == b2)
         return false;
@@ -826,9 +1607,31 @@ bool tube_isvalid(Building *b1, Building *b2, SimModel &model) {
         return false;
     if (b1 == nullptr || b2 == nullptr)
         return false;
+    if (model.tubes_at(b1->id) >= MAX_TUBES_PER_BUILDING || model.tubes_at(b2->id) >= MAX_TUBES_PER_BUILDING)
+        return false;
+    if (model.tubes_by_ends.count(tube_key(b1->id, b2->id)))
+        return false;
 
     const Point &pos1 = b1->get_pos();
     const Point &pos2 = b2->get_pos();
+
+    // Geometry only grows: a tube impossible at snapshot time stays impossible,
+    // a possible one only has to be checked against what appeared since
+    int cached = model.pondered ? model.pondered->feasible(b1->id, b2->id) : -1;
+    if (cached == 0)
+        return false;
+    if (cached == 1) {
+        for (auto it = model.tubes.lower_bound(model.pondered->tube_id_watermark); it != model.tubes.end(); ++it) {
+            if (will_overlap_tube(pos1, pos2, it->second->b1->get_pos(), it->second->b2->get_pos()))
+                return false;
+        }
+        for (const auto &building: model.pondered->unseen_buildings) {
+            if (will_overlap_building(pos1, pos2, building->get_pos()))
+                return false;
+        }
+        return true;
+    }
+
     // Tube overlap ?
     for (const auto &[id, tube]: model.tubes) {
         if (will_overlap_tube(pos1, pos2, tube->b1->get_pos(), tube->b2->get_pos())) {
@@ -849,36 +1652,389 @@ bool tube_isvalid(Building *b1, Building *b2, SimModel &model) {
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
+// PONDERING
+
+/**
+ * Copy of everything the Ponderer needs, so it never touches the live model
+ */
+struct GeometrySnapshot {
+    int                                 round;
+    int                                 tube_id_watermark;
+    std::vector<int>                    ids;
+    std::vector<Point>                  positions;
+    std::vector<std::pair<int, int>>    tubes; // Dense indices
+
+    GeometrySnapshot(const SimModel &model) : round(model.round), tube_id_watermark(0) {
+        std::map<int, int> index_of;
+        for (const auto &[id, building]: model.buildings) {
+            index_of[id] = ids.size();
+            ids.push_back(id);
+            positions.push_back(building->get_pos());
+        }
+        for (const auto &[id, tube]: model.tubes) {
+            tubes.push_back({index_of[tube->b1->id], index_of[tube->b2->id]});
+            tube_id_watermark = id + 1;
+        }
+    }
+};
+
+/**
+ * Background worker refining the tube feasibility table while the main thread blocks on std::cin
+ * Both directions are handed over through a single atomic pointer:
+ *  - submit() publishes a snapshot at the end of a turn and wakes the worker
+ *  - take() grabs whatever has been computed so far when the next turn arrives
+ * Rows are published as they are done, so a short wait still yields part of the table.
+ * take() also cancels the snapshot: the rows left would only be thrown away by the next
+ * submit(), and the turn needs the core. The worker sleeps on a condition variable between snapshots.
+ */
+class Ponderer {
+    std::atomic<GeometrySnapshot*>  inbox{nullptr};
+    std::atomic<PonderResult*>      outbox{nullptr};
+    std::atomic<bool>               stopping{false};
+    std::atomic<bool>               cancelled{false};   // Set by take(), cleared by submit()
+    std::mutex                      wake_mutex;
+    std::condition_variable         wake;
+    std::thread                     worker;
+
+    void publish(const PonderResult &result) {
+        delete outbox.exchange(new PonderResult(result));
+    }
+
+    bool superseded() const {
+        return inbox.load(std::memory_order_relaxed) != nullptr || stopping.load(std::memory_order_relaxed)
+            || cancelled.load(std::memory_order_relaxed);
+    }
+
+    void ponder(const GeometrySnapshot &snap) {
+        size_t n = snap.ids.size();
+        PonderResult result;
+        result.round = snap.round;
+        result.tube_id_watermark = snap.tube_id_watermark;
+        result.ids = snap.ids;
+        for (size_t i = 0; i < n; i++)
+            result.index_of[snap.ids[i]] = i;
+        result.tube_feasible.assign(n * n, -1);
+
+        // Tube feasibility, published every few rows
+        for (size_t i = 0; i < n; i++) {
+            if (superseded())
+                return;
+            for (size_t j = i + 1; j < n; j++) {
+                char ok = 1;
+                for (const auto &[a, b]: snap.tubes) {
+                    if (will_overlap_tube(snap.positions[i], snap.positions[j], snap.positions[a], snap.positions[b])) { ok = 0; break; }
+                }
+                for (size_t k = 0; ok && k < n; k++) {
+                    if (k == i || k == j) continue;
+                    if (will_overlap_building(snap.positions[i], snap.positions[j], snap.positions[k])) ok = 0;
+                }
+                result.tube_feasible[i * n + j] = ok;
+                result.tube_feasible[j * n + i] = ok;
+            }
+            if (i % 16 == 15)
+                publish(result);
+        }
+        publish(result);
+    }
+
+    void run() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(wake_mutex);
+                wake.wait(lock, [&]() { return stopping.load() || inbox.load() != nullptr; });
+            }
+            if (stopping.load())
+                return;
+            GeometrySnapshot *snap = inbox.exchange(nullptr);
+            if (snap == nullptr)
+                continue;
+            ponder(*snap);
+            delete snap;
+        }
+    }
+
+public:
+    void start() {
+        if (PONDERING && !worker.joinable())
+            worker = std::thread(&Ponderer::run, this);
+    }
+
+    void submit(GeometrySnapshot *snap) {
+        if (!worker.joinable()) {
+            delete snap;
+            return;
+        }
+        delete outbox.exchange(nullptr); // Stale results from the previous turn
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            cancelled.store(false);
+            delete inbox.exchange(snap);
+        }
+        wake.notify_one();
+    }
+
+    // Ownership goes to the caller, may return null
+    PonderResult *take(const SimModel &model) {
+        cancelled.store(true);
+        PonderResult *result = outbox.exchange(nullptr);
+        if (result == nullptr)
+            return nullptr;
+        for (const auto &[id, building]: model.buildings)
+            if (result->index(id) < 0)
+                result->unseen_buildings.push_back(building);
+        return result;
+    }
+
+    ~Ponderer() {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            stopping.store(true);
+        }
+        wake.notify_one();
+        if (worker.joinable())
+            worker.join();
+        delete inbox.exchange(nullptr);
+        delete outbox.exchange(nullptr);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// SPECULATION
+
+/**
+ * Copy-on-write view of the SimModel used to evaluate candidate actions
+ *
+ * Candidate links live in the overlay (never in the model, never through the id generators),
+ * cities are tracked with a union-find over the base cities, and every change is journaled
+ * so that rollback(mark) undoes a candidate in O(delta). Same idea as the Snapshot/Option
+ * simulate/proceed pair of the python prototype, without the deepcopy.
+ */
+class ModelOverlay {
+    // Theoretical link ids, far away from anything the generators will reach
+    static const int THEORY_ID_BASE = 1 << 28;
+
+    // UNDO_FLOW takes b's astronauts and modules back out of component a
+    enum UndoKind { UNDO_LINK, UNDO_TP_STATE, UNDO_PARENT, UNDO_FLOW, UNDO_SPENT };
+    struct Undo {
+        UndoKind    kind;
+        int         a, b;
+    };
+
+    const SimModel&                 base;
+    std::vector<Link*>              link_space;     // Base links then overlay links
+    std::deque<Link>                added_links;
+    std::vector<TeleporterState>    tp_states;      // By building id
+    std::vector<int>                parent;         // Union-find over components
+    std::vector<int>                component_size;
+    int                             types;          // Rows below are this long, type ids are below it
+    std::vector<float>              component_dudes;    // Astronauts by component then type
+    std::vector<int>                component_hangouts; // Modules by component then type
+    std::vector<int>                component_of;   // By building id
+    std::vector<Undo>               journal;
+    int                             spent;
+
+    int find(int c) const {
+        while (parent[c] != c)
+            c = parent[c];
+        return c;
+    }
+
+    void merge(int a, int b) {
+        a = find(a); b = find(b);
+        if (a == b)
+            return;
+        if (component_size[a] < component_size[b])
+            std::swap(a, b);
+        journal.push_back({UNDO_PARENT, b, a});
+        journal.push_back({UNDO_FLOW, a, b});
+        parent[b] = a;
+        component_size[a] += component_size[b];
+        for (int type = 0; type < types; type++) {
+            component_dudes[a * types + type] += component_dudes[b * types + type];
+            component_hangouts[a * types + type] += component_hangouts[b * types + type];
+        }
+    }
+
+    // A new component of `size` buildings with these astronauts and modules
+    int add_component(int size, const Flow &dudes, const std::map<int, int> &hangouts_types) {
+        int c = parent.size();
+        parent.push_back(c);
+        component_size.push_back(size);
+        component_dudes.resize(component_dudes.size() + types, 0);
+        component_hangouts.resize(component_hangouts.size() + types, 0);
+        for (const auto &[type, count]: dudes.data)
+            component_dudes[c * types + type] = count;
+        for (const auto &[type, count]: hangouts_types)
+            component_hangouts[c * types + type] = count;
+        return c;
+    }
+
+    void set_tp_state(const Building *b, TeleporterState state) {
+        journal.push_back({UNDO_TP_STATE, b->id, tp_states[b->id]});
+        tp_states[b->id] = state;
+    }
+
+public:
+    ModelOverlay(const SimModel &model) : base(model), link_space(model.get_all_links()), tp_states(MAX_BUILDINGS, TeleporterState::Frei),
+        types(1), component_of(MAX_BUILDINGS, -1), spent(0)
+    {
+        for (const auto &[id, building]: model.buildings) {
+            if (building->building_class == BuildingClass::PAD)
+                for (const auto &[type, count]: static_cast<const LandingPad*>(building)->get_dudes().data)
+                    types = std::max(types, type + 1);
+            else
+                types = std::max(types, building->type + 1);
+        }
+        for (const auto &city: model.cities) {
+            int c = add_component(city->buildings_ids.size(), city->dudes, city->hangouts_types);
+            for (int id: city->buildings_ids)
+                if (id < MAX_BUILDINGS) component_of[id] = c;
+        }
+        for (const auto &[id, building]: model.buildings) {
+            if (id >= MAX_BUILDINGS)
+                continue;
+            tp_states[id] = building->tp_state;
+            if (component_of[id] >= 0)
+                continue;
+            if (building->building_class == BuildingClass::PAD)
+                component_of[id] = add_component(1, static_cast<const LandingPad*>(building)->get_dudes(), {});
+            else
+                component_of[id] = add_component(1, Flow(), {{building->type, 1}});
+        }
+    }
+
+    size_t mark() const {
+        return journal.size();
+    }
+
+    void rollback(size_t mark) {
+        while (journal.size() > mark) {
+            Undo &undo = journal.back();
+            switch (undo.kind) {
+                case UNDO_LINK:
+                    link_space.pop_back();
+                    added_links.pop_back();
+                    break;
+                case UNDO_TP_STATE:
+                    tp_states[undo.a] = (TeleporterState)undo.b;
+                    break;
+                case UNDO_PARENT:
+                    parent[undo.a] = undo.a;
+                    component_size[undo.b] -= component_size[undo.a];
+                    break;
+                case UNDO_FLOW:
+                    for (int type = 0; type < types; type++) {
+                        component_dudes[undo.a * types + type] -= component_dudes[undo.b * types + type];
+                        component_hangouts[undo.a * types + type] -= component_hangouts[undo.b * types + type];
+                    }
+                    break;
+                case UNDO_SPENT:
+                    spent = undo.a;
+                    break;
+            }
+            journal.pop_back();
+        }
+    }
+
+    /**
+     * Apply a candidate link on top of the current view
+     * Returns SUCCESS, NO_FUNDS or GEOMETRIC_IMPOSSIBLE (nothing is recorded on failure)
+     */
+    int apply(const Building *b1, const Building *b2, int link_type) {
+        if (b1 == nullptr || b2 == nullptr || b1 == b2 || b1->id >= MAX_BUILDINGS || b2->id >= MAX_BUILDINGS)
+            return GEOMETRIC_IMPOSSIBLE;
+        int cost = action_cost(b1, b2, link_type);
+        if (spent + cost > base.resources)
+            return NO_FUNDS;
+        if (link_type == T_TUBE) {
+            // The base network was checked by tube_isvalid, only the other candidates are left
+            if (base.tubes_by_ends.count(tube_key(b1->id, b2->id)))
+                return GEOMETRIC_IMPOSSIBLE;
+            int tubes_at_b1 = base.tubes_at(b1->id), tubes_at_b2 = base.tubes_at(b2->id);
+            for (const auto &link: added_links) {
+                if (link.capacity == 0) continue;
+                if (tube_key(link.b1->id, link.b2->id) == tube_key(b1->id, b2->id))
+                    return GEOMETRIC_IMPOSSIBLE;
+                if (will_overlap_tube(b1->get_pos(), b2->get_pos(), link.b1->get_pos(), link.b2->get_pos()))
+                    return GEOMETRIC_IMPOSSIBLE;
+                tubes_at_b1 += link.b1 == b1 || link.b2 == b1;
+                tubes_at_b2 += link.b1 == b2 || link.b2 == b2;
+            }
+            if (tubes_at_b1 >= MAX_TUBES_PER_BUILDING || tubes_at_b2 >= MAX_TUBES_PER_BUILDING)
+                return GEOMETRIC_IMPOSSIBLE;
+        } else if (tp_states[b1->id] != TeleporterState::Frei || tp_states[b2->id] != TeleporterState::Frei)
+            return GEOMETRIC_IMPOSSIBLE;
+        record(b1, b2, link_type, cost);
+        return SUCCESS;
+    }
+
+    // Apply a link known to fit the view (LinkConflicts cleared it), without checking it again
+    void apply_cleared(const Building *b1, const Building *b2, int link_type) {
+        record(b1, b2, link_type, action_cost(b1, b2, link_type));
+    }
+
+private:
+    void record(const Building *b1, const Building *b2, int link_type, int cost) {
+        journal.push_back({UNDO_SPENT, spent, 0});
+        spent += cost;
+        int n = added_links.size();
+        if (link_type == T_TUBE)
+            added_links.emplace_back(b1, b2, THEORY_ID_BASE + n, 1);
+        else {
+            added_links.emplace_back(b1, b2, -(THEORY_ID_BASE + n), 0);
+            set_tp_state(b1, TeleporterState::Eingang);
+            set_tp_state(b2, TeleporterState::Ausgang);
+        }
+        link_space.push_back(&added_links.back());
+        journal.push_back({UNDO_LINK, 0, 0});
+        merge(component_of[b1->id], component_of[b2->id]);
+    }
+
+public:
+    const std::vector<Link*> &links() const { return link_space; }
+    int resources_left() const { return base.resources - spent; }
+    TeleporterState tp_state(const Building *b) const { return tp_states[b->id]; }
+
+    int component(int building_id) const { return find(component_of[building_id]); }
+    bool same_city(int id1, int id2) const { return component(id1) == component(id2); }
+    bool isolated(int building_id) const { return component_size[component(building_id)] == 1; }
+
+    // Supply chain as it would look with the candidates built
+    Flow dudes(int building_id) const {
+        Flow flow;
+        for (int type = 0, c = component(building_id); type < types; type++)
+            if (component_dudes[c * types + type] != 0)
+                flow.data[type] = component_dudes[c * types + type];
+        return flow;
+    }
+    int hangouts_of_type(int building_id, int type) const { return hangouts_in(component(building_id), type); }
+    int hangouts_in(int component, int type) const {
+        return type >= 0 && type < types ? component_hangouts[component * types + type] : 0;
+    }
+    int components() const { return parent.size(); }
+    bool reaches_type(int building_id, int type) const { return hangouts_of_type(building_id, type) > 0; }
+    Flow overflow(int building_id) const {
+        std::map<int, int> hangouts_types;
+        for (int type = 0; type < types; type++)
+            if (int count = hangouts_of_type(building_id, type))
+                hangouts_types[type] = count;
+        return Flow::get_overflow(dudes(building_id), hangouts_types);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
 // O(n**2)
 void magic_1(std::vector<Building*> &best_conections_to_drain, const t_drains &all_drains, const Point &pos, const Flow &src_flow, const void* skip)
 {
-    std::vector<Building *> best_ones;
-    for (const auto& [drain_city, drain_hangout, flow] : all_drains) {
-        if (skip != nullptr and skip == drain_city)
+    for (const auto &drain : all_drains) {
+        if (skip != nullptr and skip == std::get<0>(drain))
             continue;
-        if (drain_city) {
-            best_ones = drain_city->find_closest_buildings(pos, src_flow);
-            for (auto building : best_ones) {
-                if (building != nullptr)
-                    best_conections_to_drain.push_back(building);
-            }
-        }
-        else { // If the drain is a hangout
-            if (flow.has_type(drain_hangout->type)) {
-                best_conections_to_drain.push_back(drain_hangout);
-                if (LOGGING_PARSING)
-                    log("Hangout matching: " + std::to_string(drain_hangout->id) + " Sourceflow: " + src_flow.to_string());
-            }
-            else {
-                if (LOGGING_PARSING)
-                    log("Hangout not matching: " + std::to_string(drain_hangout->id) + " Sourceflow: " + src_flow.to_string());
-            }
-        }
+        buildings_to_drain(best_conections_to_drain, drain, pos, src_flow);
     }
 }
 
@@ -907,10 +2063,9 @@ std::vector<Building*> get_best_drains_for_source(const City* working_city, cons
 }
 
 
-bool    connect_buildings(SimModel &model, Building *b1, Building *b2, int link_type)
+// Put b1 and b2 in the same city, creating or merging cities as needed
+void    join_cities(SimModel &model, Building *b1, Building *b2)
 {
-    if (!b1 or !b2 )
-        return false;
     if (b1->city == nullptr and b2->city == nullptr) {
         //CREATE NEW CITY
         City *new_city = new City();
@@ -943,29 +2098,165 @@ bool    connect_buildings(SimModel &model, Building *b1, Building *b2, int link_
     } else if (b1->city != b2->city) {
         // MERGE CITIES
         log("Merge cities");
-        b1->city->merge_city(*b2->city);
+        City *absorbed = b2->city; // merge_city re-homes b2, keep the old city to delete it
+        b1->city->merge_city(*absorbed);
+        model.supply.on_cities_merged(b1->city, absorbed);
         log("Merged cities");
-        for (const auto& city: model.cities) {
-            if (city == b2->city) {
-                model.cities.erase(std::remove(model.cities.begin(), model.cities.end(), city), model.cities.end());
-                delete city;
-                break;
-            }
-        }
+        model.cities.erase(std::remove(model.cities.begin(), model.cities.end(), absorbed), model.cities.end());
+        delete absorbed;
     }
+}
+
+// Mark both ends of a teleporter and hand it to their city
+void    attach_teleporter(Building *b1, Building *b2, Teleporter *tele)
+{
+    b1->tp_state = TeleporterState::Eingang;
+    b2->tp_state = TeleporterState::Ausgang;
+    b1->bulding_conected_for_tp = b2;
+    b2->bulding_conected_for_tp = b1;
+    b1->city->add_link(tele);
+}
+
+bool    connect_buildings(SimModel &model, Building *b1, Building *b2, int link_type)
+{
+    if (!b1 or !b2 )
+        return false;
+    join_cities(model, b1, b2);
     if (link_type == T_TUBE) {
         Tube *tube = new Tube(b1, b2);
         model.tubes[tube->id] = tube;
+        model.tubes_by_ends[tube_key(b1->id, b2->id)] = tube;
+        model.tube_count[b1->id]++;
+        model.tube_count[b2->id]++;
+        b1->city->add_link(tube);
+        model.supply.on_link_built(tube);
     }
     else if (link_type == T_TELE) {
         Teleporter *tele = new Teleporter(b1, b2);
         model.teleporters[tele->id] = tele;
-        b1->tp_state = TeleporterState::Eingang;
-        b2->tp_state = TeleporterState::Ausgang;
+        model.teleporters_by_entrance[b1->id] = tele;
+        attach_teleporter(b1, b2, tele);
+        model.supply.on_link_built(tele);
     }
     return true;
 }
 
+/**
+ * Regroup every building into cities from the links still standing
+ * Cities only ever grow through connect_buildings, this is for the rare turns
+ * where the referee refused a link the model already counted
+ */
+void    rebuild_cities(SimModel &model)
+{
+    for (City *city: model.cities)
+        delete city;
+    model.cities.clear();
+    for (auto &[id, building]: model.buildings) {
+        building->city = nullptr;
+        building->tp_state = TeleporterState::Frei;
+        building->bulding_conected_for_tp = nullptr;
+        if (building->building_class == BuildingClass::PAD)
+            model.isolated_pads.insert(id);
+        else
+            model.isolated_hangouts.insert(id);
+    }
+    for (auto &[id, tube]: model.tubes) {
+        Building *b1 = model.buildings.at(tube->b1->id), *b2 = model.buildings.at(tube->b2->id);
+        join_cities(model, b1, b2);
+        b1->city->add_link(tube);
+    }
+    for (auto &[id, tele]: model.teleporters) {
+        Building *b1 = model.buildings.at(tele->b1->id), *b2 = model.buildings.at(tele->b2->id);
+        join_cities(model, b1, b2);
+        attach_teleporter(b1, b2, tele);
+    }
+    model.supply.resync(model.buildings);
+}
+
+/**
+ * Sync the model with the network the referee reported
+ *
+ * The model already holds what it built last turn, so in the usual case every reported
+ * link and pod is found by its ends or id and nothing is allocated. The diff against
+ * those expectations is logged: unknown links and pods are adopted, capacities are
+ * resynced, and whatever the referee refused (unaffordable, too many tubes...) is dropped.
+ */
+void    reconcile_network(SimModel &model)
+{
+    int adopted = 0, resynced = 0, dropped = 0;
+    std::set<int> seen_tubes, seen_teleporters;
+
+    for (const auto &reported: model.reported_links) {
+        auto b1 = model.buildings.find(reported.b1), b2 = model.buildings.find(reported.b2);
+        if (b1 == model.buildings.end() || b2 == model.buildings.end())
+            continue;
+        if (reported.capacity == 0) {
+            auto it = model.teleporters_by_entrance.find(reported.b1);
+            if (it == model.teleporters_by_entrance.end() || it->second->b2->id != reported.b2) {
+                connect_buildings(model, b1->second, b2->second, T_TELE);
+                it = model.teleporters_by_entrance.find(reported.b1);
+                adopted++;
+            }
+            seen_teleporters.insert(it->second->id);
+            continue;
+        }
+        auto key = tube_key(reported.b1, reported.b2);
+        auto it = model.tubes_by_ends.find(key);
+        if (it == model.tubes_by_ends.end()) {
+            connect_buildings(model, b1->second, b2->second, T_TUBE);
+            it = model.tubes_by_ends.find(key);
+            adopted++;
+        }
+        if (it->second->capacity != reported.capacity) {
+            it->second->capacity = reported.capacity;
+            resynced++;
+        }
+        seen_tubes.insert(it->second->id);
+    }
+
+    // Links we counted on but the referee never built
+    bool lost_links = false;
+    for (auto it = model.tubes.begin(); it != model.tubes.end();) {
+        if (seen_tubes.count(it->first)) { ++it; continue; }
+        model.tubes_by_ends.erase(tube_key(it->second->b1->id, it->second->b2->id));
+        model.tube_count[it->second->b1->id]--;
+        model.tube_count[it->second->b2->id]--;
+        delete it->second;
+        it = model.tubes.erase(it);
+        lost_links = true;
+        dropped++;
+    }
+    for (auto it = model.teleporters.begin(); it != model.teleporters.end();) {
+        if (seen_teleporters.count(it->first)) { ++it; continue; }
+        model.teleporters_by_entrance.erase(it->second->b1->id);
+        delete it->second;
+        it = model.teleporters.erase(it);
+        lost_links = true;
+        dropped++;
+    }
+    if (lost_links)
+        rebuild_cities(model);
+
+    // Pods: same ids both sides, the route must match too
+    for (auto it = model.pods.begin(); it != model.pods.end();) {
+        auto reported = model.reported_pods.find(it->first);
+        if (reported != model.reported_pods.end() && reported->second == it->second->route) { ++it; continue; }
+        delete it->second;
+        it = model.pods.erase(it);
+        dropped++;
+    }
+    for (const auto &[id, route]: model.reported_pods) {
+        if (model.pods.count(id))
+            continue;
+        model.pods[id] = new Pod(id, route);
+        adopted++;
+    }
+
+    if (adopted || resynced || dropped)
+        log("Reconciled network: adopted " + std::to_string(adopted) + ", resynced " + std::to_string(resynced)
+            + ", dropped " + std::to_string(dropped));
+}
+
 //////////////////////////////////////////////////
 // ██████  ██    ██ ████████ ██   ██ ███    ███ //
 // ██   ██  ██  ██     ██    ██   ██ ████  ████ //
@@ -986,30 +2277,235 @@ bool    connect_buildings(SimModel &model, Building *b1, Building *b2, int link_
  */
 t_DudeSupplyChain check_dude_supply_chain(SimModel &model)
 {
-    t_DudeSupplyChain supply_chain;
+    t_DudeSupplyChain supply_chain = model.supply.supply_chain(model.cities);
 
-    t_sources &sources = supply_chain.first;
-    t_drains &drains = supply_chain.second;
+    log("Supply chain: drains: " + std::to_string(supply_chain.second.size()) + ", sources: " + std::to_string(supply_chain.first.size())
+        + ", changes this round: " + std::to_string(model.supply.changes().size()));
+
+    return supply_chain;
+}
+
+struct TeleporterPlan {
+    Building*   entrance;
+    Building*   exit;
+    int         gain;   // Points per month
+};
+
+// Distance from a building to the nearest hangout of `type` through the current network
+int distance_to_type(const Building *b, int type) {
+    if (b->city != nullptr)
+        return b->city->distances.distance(type, b->id);
+    return b->building_class == BuildingClass::HANGOUT && b->type == type ? 0 : UNREACHABLE_DISTANCE;
+}
+
+/**
+ * Rank every free (entrance, exit) pair by the hop distance it saves, weighted by the astronauts of each pad
+ *
+ * A pad P reaching the entrance E in h hops gets, for each of its types t, the new distance
+ * h + d(X, t) instead of d(P, t). Astronauts only board if the exit is not farther from
+ * their target than the entrance (d(X, t) <= d(E, t)), other types are left untouched.
+ * Reaching a type that was unreachable is worth most of its 100 points.
+ * Entrances are searched up to MAX_ROUTE_DEPTH hops away from a pad.
+ */
+std::vector<TeleporterPlan> plan_teleporters(const SimModel &model, size_t keep)
+{
+    std::vector<Building*> free_buildings;
+    for (const auto &[id, building]: model.buildings) {
+        if (id >= MAX_BUILDINGS || building->tp_state != TeleporterState::Frei)
+            continue;
+        free_buildings.push_back(building);
+    }
+    size_t n = free_buildings.size();
+    std::vector<int> gains(n * n, 0);
+    std::vector<int> hops;
 
-    // Ratios
-    for (const auto& city : model.cities) {
-        sources.push_back(std::make_tuple(city, nullptr, Flow::get_overflow(city->dudes, city->hangouts_types)));
-        drains.push_back(std::make_tuple(city, nullptr, Flow::get_overflow(city->dudes, city->hangouts_types)));
+    // d(building, type) for every free building, looked up n*n times per pad otherwise
+    std::map<int, std::vector<int>> type_distance;
+    for (const auto &[id, building]: model.buildings) {
+        if (building->building_class != BuildingClass::PAD)
+            continue;
+        for (const auto &[type, count]: dynamic_cast<const LandingPad *>(building)->get_dudes().data) {
+            if (type_distance.count(type))
+                continue;
+            std::vector<int> &column = type_distance[type];
+            for (const auto &b: free_buildings)
+                column.push_back(distance_to_type(b, type));
+        }
     }
-    // Sources
-    for (const auto& id : model.isolated_pads) {
-        sources.push_back(std::make_tuple(nullptr, \
-        dynamic_cast<LandingPad*>(model.buildings[id]), dynamic_cast<LandingPad*>(model.buildings[id])->dudes));
+
+    for (const auto &[pad_id, building]: model.buildings) {
+        if (building->building_class != BuildingClass::PAD || pad_id >= MAX_BUILDINGS)
+            continue;
+        const Flow &flow = dynamic_cast<const LandingPad *>(building)->get_dudes();
+
+        if (building->city != nullptr)
+            building->city->distances.hops_from(pad_id, hops);
+        else {
+            hops.assign(MAX_BUILDINGS, UNREACHABLE_DISTANCE);
+            hops[pad_id] = 0;
+        }
+
+        for (size_t e = 0; e < n; e++) {
+            const Building *entrance = free_buildings[e];
+            int h = hops[entrance->id];
+            if (h > MAX_ROUTE_DEPTH)
+                continue;
+            for (size_t x = 0; x < n; x++) {
+                if (x == e) continue;
+                int gain = 0;
+                for (const auto &[type, count]: flow.data) {
+                    const std::vector<int> &column = type_distance[type];
+                    int at_exit = column[x];
+                    if (at_exit >= UNREACHABLE_DISTANCE || at_exit > column[e])
+                        continue;
+                    int before = distance_to_type(building, type);
+                    int after = h + at_exit;
+                    if (after >= before)
+                        continue;
+                    gain += count * (before >= UNREACHABLE_DISTANCE ? 100 - after : before - after);
+                }
+                gains[e * n + x] += gain;
+            }
+        }
     }
-    // Drains
-    for (const auto& id : model.isolated_hangouts) {
-        drains.push_back(std::make_tuple(nullptr, \
-        dynamic_cast<Hangout*>(model.buildings[id]), Flow(model.buildings[id]->type)));
+
+    std::vector<TeleporterPlan> plans;
+    for (size_t e = 0; e < n; e++)
+        for (size_t x = 0; x < n; x++)
+            if (gains[e * n + x] > 0)
+                plans.push_back({free_buildings[e], free_buildings[x], gains[e * n + x]});
+    std::sort(plans.begin(), plans.end(), [](const TeleporterPlan &a, const TeleporterPlan &b) { return a.gain > b.gain; });
+
+    // One teleporter per building, keep the best plan for each
+    std::vector<TeleporterPlan> kept;
+    std::set<const Building*> used;
+    for (const auto &plan: plans) {
+        if (kept.size() >= keep)
+            break;
+        if (used.count(plan.entrance) || used.count(plan.exit))
+            continue;
+        used.insert(plan.entrance);
+        used.insert(plan.exit);
+        kept.push_back(plan);
     }
+    return kept;
+}
 
-    log("Supply chain: drains: " + std::to_string(supply_chain.second.size()) + ", sources: " + std::to_string(supply_chain.first.size()));
+////////////////////////////////////////////////////////////////////////////////
+// STEINER NETWORK
 
-    return supply_chain;
+/**
+ * Tubes linking every stray pad to a hangout of each type it carries, for the least tube length
+ *
+ * Shortest path heuristic for the Steiner tree: pads (then their types, most astronauts first)
+ * are connected one at a time by a Dijkstra over the complete geometric graph, where a new
+ * tube costs its price and existing links or tubes already planned cost nothing. Any building
+ * can be a Steiner point on the way, and a city that already reaches the type is as good as
+ * the hangout itself. Planned tubes never cross each other nor overload a building.
+ */
+t_actions plan_steiner_network(SimModel &model)
+{
+    std::vector<Building*> nodes;
+    std::vector<int> dense(MAX_BUILDINGS, -1);
+    for (const auto &[id, building]: model.buildings) {
+        if (id >= MAX_BUILDINGS) continue;
+        dense[id] = nodes.size();
+        nodes.push_back(building);
+    }
+    size_t n = nodes.size();
+
+    std::vector<std::vector<int>> free_edges(n); // Existing links and planned tubes, one way for teleporters
+    for (const auto &[id, tube]: model.tubes) {
+        int a = dense[tube->b1->id], b = dense[tube->b2->id];
+        if (a < 0 || b < 0) continue;
+        free_edges[a].push_back(b);
+        free_edges[b].push_back(a);
+    }
+    for (const auto &[id, tele]: model.teleporters)
+        if (dense[tele->b1->id] >= 0 && dense[tele->b2->id] >= 0)
+            free_edges[dense[tele->b1->id]].push_back(dense[tele->b2->id]);
+
+    std::vector<signed char> feasible(n * n, -1);
+    std::vector<int> tubes_at(n);
+    for (size_t i = 0; i < n; i++)
+        tubes_at[i] = model.tubes_at(nodes[i]->id);
+    std::vector<std::pair<size_t, size_t>> planned;
+
+    auto can_build = [&](size_t a, size_t b) {
+        if (tubes_at[a] >= MAX_TUBES_PER_BUILDING || tubes_at[b] >= MAX_TUBES_PER_BUILDING)
+            return false;
+        signed char &known = feasible[a * n + b];
+        if (known < 0)
+            known = feasible[b * n + a] = tube_isvalid(nodes[a], nodes[b], model);
+        if (!known)
+            return false;
+        for (const auto &[p, q]: planned)
+            if (will_overlap_tube(nodes[a]->get_pos(), nodes[b]->get_pos(), nodes[p]->get_pos(), nodes[q]->get_pos()))
+                return false;
+        return true;
+    };
+
+    std::vector<int> dist(n);
+    std::vector<int> prev(n);
+    std::vector<char> done(n), is_free(n);
+    for (int pad_id: model.isolated_pads) {
+        if (pad_id >= MAX_BUILDINGS) continue;
+        size_t source = dense[pad_id];
+        std::vector<std::pair<float, int>> types;
+        for (const auto &[type, count]: static_cast<LandingPad*>(nodes[source])->get_dudes().data)
+            if (count > 0) types.push_back({count, type});
+        std::sort(types.rbegin(), types.rend());
+
+        for (const auto &[count, type]: types) {
+            auto is_target = [&](size_t i) {
+                return (nodes[i]->building_class == BuildingClass::HANGOUT && nodes[i]->type == type)
+                    || (nodes[i]->city != nullptr && nodes[i]->city->distances.distance(type, nodes[i]->id) < UNREACHABLE_DISTANCE);
+            };
+            // Dense Dijkstra, the graph is complete
+            std::fill(dist.begin(), dist.end(), std::numeric_limits<int>::max());
+            std::fill(prev.begin(), prev.end(), -1);
+            std::fill(done.begin(), done.end(), 0);
+            dist[source] = 0;
+            int target = -1;
+            for (size_t round = 0; round < n; round++) {
+                int u = -1;
+                for (size_t i = 0; i < n; i++)
+                    if (!done[i] && dist[i] != std::numeric_limits<int>::max() && (u < 0 || dist[i] < dist[u]))
+                        u = i;
+                if (u < 0) break;
+                done[u] = 1;
+                if (is_target(u)) { target = u; break; }
+                std::fill(is_free.begin(), is_free.end(), 0);
+                for (int v: free_edges[u]) {
+                    is_free[v] = 1;
+                    if (dist[u] < dist[v]) { dist[v] = dist[u]; prev[v] = u; }
+                }
+                for (size_t v = 0; v < n; v++) {
+                    if (done[v] || is_free[v] || (size_t)u == v) continue;
+                    int cost = dist[u] + tube_cost(nodes[u], nodes[v]);
+                    if (cost < dist[v] && can_build(u, v)) { dist[v] = cost; prev[v] = u; }
+                }
+            }
+            if (target < 0 || dist[target] == 0)
+                continue;
+            for (int v = target; prev[v] >= 0; v = prev[v]) {
+                int u = prev[v];
+                if (std::find(free_edges[u].begin(), free_edges[u].end(), v) != free_edges[u].end())
+                    continue;
+                planned.push_back({(size_t)u, (size_t)v});
+                free_edges[u].push_back(v);
+                free_edges[v].push_back(u);
+                tubes_at[u]++;
+                tubes_at[v]++;
+            }
+        }
+    }
+
+    t_actions tubes;
+    for (const auto &[a, b]: planned)
+        tubes.push_back({nodes[a], nodes[b], T_TUBE});
+    log("Steiner network: " + std::to_string(tubes.size()) + " tubes");
+    return tubes;
 }
 
 t_actions    suggest_links_for_supply_chain(SimModel &model, t_DudeSupplyChain &supply_chain)
@@ -1026,24 +2522,11 @@ t_actions    suggest_links_for_supply_chain(SimModel &model, t_DudeSupplyChain &
     t_actions available_new_links; // building_id1, building_id2, link_type(T_TUBE or T_TELE)
     //TO-DO: Later, find the longest distance between a source and drain in the same city and connect them
 
+    // Stray pads are served by the Steiner network, one tree for all of them instead of a star per pad
+    available_new_links = plan_steiner_network(model);
     for (const auto &[city, pad, flow] : sources) {
-        if (pad != nullptr) {
-            std::vector<Building *> all_building_that_can_drain = get_best_drains_for_source(nullptr, pad, drains);
-            if (all_building_that_can_drain.empty()) {
-                log("No building can drain from pad: " + std::to_string(pad->id));
-                continue;
-            }
-
-            for (auto drain_building : all_building_that_can_drain) {
-                if (tube_isvalid(pad, drain_building, model))
-                    available_new_links.push_back({pad, drain_building, T_TUBE});
-                else {log("Tube not valid: " + std::to_string(pad->id) + " " + std::to_string(drain_building->id));}
-                if (teleporter_isvalid(pad, drain_building))
-                    available_new_links.push_back({pad, drain_building, T_TELE});
-                else {log("Teleporter not valid: " + std::to_string(pad->id) + " " + std::to_string(drain_building->id));}
-            }
-        } else {
-            std::vector<Building *> all_building_that_can_drain = get_best_drains_for_source(city, nullptr, drains);
+        if (pad == nullptr) {
+            std::vector<Building *> all_building_that_can_drain = model.drains.best_drains(city, drains);
             if (all_building_that_can_drain.empty()) {
                 log("No building can drain from city");
                 continue;
@@ -1056,23 +2539,40 @@ t_actions    suggest_links_for_supply_chain(SimModel &model, t_DudeSupplyChain &
                     if (tube_isvalid(pad, drain_building, model)) {
                         available_new_links.push_back({pad, drain_building, T_TUBE}); ok = true;
                     } else {log("Tube not valid: " + std::to_string(pad->id) + " " + std::to_string(drain_building->id));}
-                    if (teleporter_isvalid(pad, drain_building)) {
-                        available_new_links.push_back({pad, drain_building, T_TELE}); ok = true;
-                    }else {log("Teleporter not valid: " + std::to_string(pad->id) + " " + std::to_string(drain_building->id));}
                 }
                 for (auto &[id, hangout]: city->hangouts) {
                     if (ok) break;
                     if (tube_isvalid(hangout, drain_building, model)) {
                         available_new_links.push_back({hangout, drain_building, T_TUBE}); ok = true;
                     }
-                    if (teleporter_isvalid(hangout, drain_building)) {
-                        available_new_links.push_back({hangout, drain_building, T_TELE}); ok = true;
-                    }
                 }
             }
         }
     }
-    return available_new_links;
+    auto [reused, computed] = model.drains.take_counts();
+    log("Drain pairs: " + std::to_string(reused) + " reused, " + std::to_string(computed) + " computed");
+
+    // Teleporters are too expensive to scatter, only the pairs that save the most hops are proposed
+    model.teleporter_gains.clear();
+    for (const auto &plan: plan_teleporters(model, MAX_TELEPORTER_PLANS)) {
+        if (!teleporter_isvalid(plan.entrance, plan.exit))
+            continue;
+        model.teleporter_gains[{plan.entrance->id, plan.exit->id}] = plan.gain;
+        available_new_links.push_back({plan.entrance, plan.exit, T_TELE});
+    }
+
+    // A link suggested twice (a tube either way round) would be two genes of the same design
+    std::set<std::tuple<int, int, int>> suggested;
+    t_actions unique_links;
+    for (const auto &link: available_new_links) {
+        const auto &[b1, b2, link_type] = link;
+        int from = b1->id, to = b2->id;
+        if (link_type == T_TUBE && from > to)
+            std::swap(from, to);
+        if (suggested.insert({from, to, link_type}).second)
+            unique_links.push_back(link);
+    }
+    return unique_links;
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -1085,182 +2585,2125 @@ int min(int a, int b) {
     return a < b ? a : b;
 }
 
-/*
-Returns a list of approxiamtely target_sample_width links
-*/
-t_actions    sample_links(const t_actions &suggested_links, size_t target_sample_width, int budget)
-{
-    if (target_sample_width > 20)
-        target_sample_width = 15;
-    // Get a random 'target_sample_width'
-    // max(1, min(target_sample_width, suggested_links.size()))
-
+////////////////////////////////////////////////////////////////////////////////
+// ARRIVAL PREDICTION
 
-    static std::random_device rd;
-    // Generate a sublist with random sampling
-    std::vector<int> indices(suggested_links.size());
-    std::iota(indices.begin(), indices.end(), 0);
-    std::shuffle(indices.begin(), indices.end(), rd);
+struct FleetPod {
+    int             id;
+    const t_route*  route;
+};
 
-    int max_samples = max(1, min(target_sample_width, suggested_links.size()));
-    int cost = 0;
-    t_actions sampled_links;
-    for (int i=0; i < max_samples;i++) {
-        if (std::get<2>(suggested_links[indices[i]]) == T_TUBE) {
-            int dist = std::get<0>(suggested_links[indices[i]])->get_pos().distance(std::get<1>(suggested_links[indices[i]])->get_pos());
-            cost += TUBE_PRICE * dist + 100; // 100 for an average pod price
-        }
-        else {
-            if (budget - cost < TELEPORTER_PRICE) continue;
-            cost += TELEPORTER_PRICE;
+// Where a pod stands on its route; every pod starts the month on its first stop
+struct PodCursor {
+    size_t  index = 0;
+    int     direction = 1;
+
+    // Next position: closed routes loop, open ones bounce at both ends
+    PodCursor advanced(const t_route &route) const {
+        PodCursor next = *this;
+        if (route.front() == route.back()) {
+            next.index = index + 1 >= route.size() - 1 ? 0 : index + 1;
+            return next;
         }
-        if (cost > budget)
-            break;
-        sampled_links.push_back(suggested_links[indices[i]]);
+        if ((direction > 0 && index + 1 >= route.size()) || (direction < 0 && index == 0))
+            next.direction = -direction;
+        next.index += next.direction;
+        return next;
     }
-    return sampled_links;
+};
+
+std::map<std::pair<int, int>, int> tube_capacities(const SimModel &model)
+{
+    std::map<std::pair<int, int>, int> capacity;
+    for (const auto &[id, tube]: model.tubes)
+        capacity[tube_key(tube->b1->id, tube->b2->id)] = tube->capacity;
+    return capacity;
 }
 
-/*
-    Find the best combinaison of routes using the available links
+std::vector<FleetPod> current_fleet(const SimModel &model)
+{
+    std::vector<FleetPod> fleet;
+    for (const auto &[id, pod]: model.pods)
+        fleet.push_back({id, &pod->route});
+    return fleet;
+}
 
-    Returns (score, routes)
-*/
-t_routes_and_scores make_paths(const std::vector<Link*> link_space, const t_DudeSupplyChain &supply_chain, int budget, SimModel& model)
+// Every city in a single field, cities share no building so their distances never mix
+DistanceField network_field(const SimModel &model)
 {
-    if (budget <= 0) {
-        return {};
-    }
+    DistanceField field;
+    for (const auto &[id, building]: model.buildings)
+        if (building->building_class == BuildingClass::HANGOUT && id < MAX_BUILDINGS)
+            field.add_hangout(id, building->type);
+    for (const auto &[id, tube]: model.tubes)
+        field.add_tube(tube->b1->id, tube->b2->id);
+    for (const auto &[id, tele]: model.teleporters)
+        field.add_teleporter(tele->b1->id, tele->b2->id);
+    return field;
+}
 
-    t_routes_and_scores selected_routes;
+#define BALANCE_POINTS 50
 
-    // This is what the final graph will look like with the routes
-    // std::map<const Building*, std::vector<const Building*> > final_adjency_list;
-    // std::map<const Building*, std::vector<const Building*> > tmp_adjency_list;
+/**
+ * Population-balance points of a module receiving `n` astronauts in a month:
+ * the k-th arrival (from 0) is worth max(0, 50 - k), the order does not matter
+ */
+inline int balance_points(int n) {
+    if (n <= 0)
+        return 0;
+    int paid = min(n, BALANCE_POINTS + 1);
+    return paid * BALANCE_POINTS - paid * (paid - 1) / 2;
+}
 
-    // This is what can be used
-    std::map<const Building*, std::vector<const Building*> > tube_links_per_building;
-    // std::map<const Building*, std::vector<const Building*> > teleporter_links_per_building; // No use ?
+/**
+ * Monthly inflow of every hangout (hangouts only take their own type) and the balance points it earns
+ * Adding or moving a cohort is O(1) and returns the change in points, so candidates can be
+ * tried and undone with the opposite call
+ * Inflows are kept by building id, a reset forecast reuses them without allocating.
+ */
+class BalanceModel {
+    std::vector<int>    inflow = std::vector<int>(MAX_BUILDINGS, 0);    // By hangout id: astronauts per month
+    int                 points = 0;
 
-    for (const auto &link: link_space) {
-        if (link->id >= 0) {
-            tube_links_per_building[link->b1].push_back(link->b2);
-            // tmp_adjency_list[link->b1].push_back(link->b2);
-            tube_links_per_building[link->b2].push_back(link->b1);
-        }
-        else {
-            // teleporter_links_per_building[link->b1].push_back(link->b2);
-            // final_adjency_list[link->b1].push_back(link->b2);
-            // tmp_adjency_list[link->b1].push_back(link->b2);
-        }
+public:
+    int score() const { return points; }
+
+    void reset() {
+        std::fill(inflow.begin(), inflow.end(), 0);
+        points = 0;
     }
 
-    size_t combinaisons = 0;
-    for (const auto &[working_building, conected_buildings]: tube_links_per_building) {
+    int inflow_of(int hangout) const {
+        return hangout >= 0 && hangout < MAX_BUILDINGS ? inflow[hangout] : 0;
+    }
 
-        int             score = 0;
+    // Change in points if `n` more astronauts reached `hangout`, -1 for nowhere
+    int gain_if_added(int hangout, int n) const {
+        if (hangout < 0 || hangout >= MAX_BUILDINGS)
+            return 0;
+        int now = inflow[hangout];
+        return balance_points(now + n) - balance_points(now);
+    }
 
-        std::set<int> excluded_id;
-        std::set<int> visited_types;
-        t_route route;
+    int gain_if_redirected(int from, int to, int n) const {
+        if (from == to)
+            return 0;
+        return gain_if_added(from, -n) + gain_if_added(to, n);
+    }
+
+    int add(int hangout, int n) {
+        int gain = gain_if_added(hangout, n);
+        if (hangout >= 0 && hangout < MAX_BUILDINGS)
+            inflow[hangout] += n;
+        points += gain;
+        return gain;
+    }
+
+    int redirect(int from, int to, int n) {
+        return add(from, -n) + add(to, n);
+    }
+};
+
+struct ArrivalForecast {
+    struct Landing {
+        int pad, type, hangout, day, count;
+
+        bool operator<(const Landing &other) const {
+            return std::tie(pad, type, hangout, day) < std::tie(other.pad, other.type, other.hangout, other.day);
+        }
+    };
+    std::vector<Landing> landings;  // Sorted once the month is replayed
+    BalanceModel balance;   // Inflow of every module
+    int speed_points = 0;   // Sum of 50 - day over the arrivals
+    int arrived = 0;
+    int total = 0;
+
+    void reset() {
+        landings.clear();
+        balance.reset();
+        speed_points = arrived = total = 0;
+    }
+
+    // Hangout a pad cohort ends up in this month, -1 if it does not arrive
+    int destination_of(int pad, int type) const {
+        auto [first, last] = cohort(pad, type);
+        int best = -1, most = 0;
+        while (first != last) {
+            int hangout = first->hangout, n = 0;
+            for (; first != last && first->hangout == hangout; ++first)
+                n += first->count;
+            if (n > most) { best = hangout; most = n; }
+        }
+        return best;
+    }
+
+    // Mean day of arrival of a pad cohort, -1 if none of it arrives this month
+    double expected_day(int pad, int type) const {
+        auto [first, last] = cohort(pad, type);
+        double days = 0, count = 0;
+        for (; first != last; ++first) { days += (double)first->day * first->count; count += first->count; }
+        return count > 0 ? days / count : -1;
+    }
+
+private:
+    std::pair<std::vector<Landing>::const_iterator, std::vector<Landing>::const_iterator> cohort(int pad, int type) const {
+        auto first = std::lower_bound(landings.begin(), landings.end(), Landing{pad, type, INT_MIN, INT_MIN, 0});
+        auto last = first;
+        while (last != landings.end() && last->pad == pad && last->type == type)
+            ++last;
+        return {first, last};
+    }
+};
+
+/**
+ * Buffers of predict_arrivals, kept by the caller so forecasting candidate after candidate
+ * does not allocate once they have grown to the size of the fleet and of the crowd
+ */
+struct ArrivalScratch {
+    struct Group {
+        int pad, type, at, count;
+        const std::vector<int> *dist;   // The field of the type, looked up once
+        size_t order;                   // Place before the day's sort, which keeps it for equal pads
+
+        int distance(int id) const { return id >= 0 && id < MAX_BUILDINGS ? (*dist)[id] : UNREACHABLE_DISTANCE; }
+    };
+    std::vector<FleetPod>                               sorted;     // The fleet by id, when given out of order
+    std::vector<char>                                   served;     // By building id: a stop of some pod
+    std::vector<Group>                                  groups, boarded;
+    std::vector<PodCursor>                              cursors, next;
+    std::vector<char>                                   moving;
+    std::vector<int>                                    seats;
+    std::vector<std::pair<std::pair<int, int>, int>>    used;       // (tube, pods through today), sorted
+    std::vector<std::pair<int, size_t>>                 at_stop;    // (stop, pod index) of the moving pods, sorted
+};
+
+/**
+ * When each pad cohort reaches its module, replaying one month the way the referee plays it
+ *
+ * Astronauts are moved in groups (pad, type, building). Each day: teleporters first, then
+ * pods claim tube slots by increasing id, then groups board by increasing pad id into the
+ * first moving pod (smallest id) whose next stop is strictly closer on their distance field,
+ * ten seats per pod, and land. Arriving on day d is worth 50 - d speed points.
+ * `days` cuts the month short for cheaper, rougher forecasts.
+ * The forecast is reset and written in place.
+ */
+void predict_arrivals(const SimModel &model, const DistanceField &field, const std::vector<FleetPod> &fleet,
+    const std::map<std::pair<int, int>, int> &capacity, ArrivalScratch &scratch, ArrivalForecast &forecast,
+    int days = DAYS_PER_MONTH)
+{
+    auto by_id = [](const FleetPod &a, const FleetPod &b) { return a.id < b.id; };
+    if (!std::is_sorted(fleet.begin(), fleet.end(), by_id)) {
+        scratch.sorted = fleet;
+        std::sort(scratch.sorted.begin(), scratch.sorted.end(), by_id);
+        predict_arrivals(model, field, scratch.sorted, capacity, scratch, forecast, days);
+        return;
+    }
+    typedef ArrivalScratch::Group Group;
+    std::vector<char> &served = scratch.served;
+    served.assign(MAX_BUILDINGS, 0);
+    for (const auto &pod: fleet)
+        for (int stop: *pod.route)
+            if (stop >= 0 && stop < MAX_BUILDINGS) served[stop] = 1;
+
+    forecast.reset();
+    std::vector<Group> &groups = scratch.groups;
+    groups.clear();
+    for (const auto &[id, building]: model.buildings) {
+        if (building->building_class != BuildingClass::PAD || id >= MAX_BUILDINGS)
+            continue;
+        for (const auto &[type, count]: static_cast<const LandingPad*>(building)->get_dudes().data) {
+            if (count <= 0) continue;
+            forecast.total += (int)count;
+            // Cohorts no pod or teleporter can ever move are left out of the replay
+            const std::vector<int> *dist = field.distances(type);
+            if (dist == nullptr || (*dist)[id] >= UNREACHABLE_DISTANCE || (!served[id] && field.teleporter_exit(id) < 0))
+                continue;
+            groups.push_back({id, type, id, (int)count, dist, 0});
+        }
+    }
+
+    std::vector<PodCursor> &cursors = scratch.cursors, &next = scratch.next;
+    cursors.assign(fleet.size(), PodCursor());
+    next.resize(fleet.size());
+    std::vector<char> &moving = scratch.moving;
+    moving.resize(fleet.size());
+    std::vector<int> &seats = scratch.seats;
+    seats.resize(fleet.size());
+    auto &used = scratch.used;
+    auto &at_stop = scratch.at_stop;
+    std::vector<Group> &boarded = scratch.boarded;
+
+    auto land = [&](Group &group, int day) {
+        forecast.landings.push_back({group.pad, group.type, group.at, day, group.count});
+        forecast.balance.add(group.at, group.count);
+        forecast.speed_points += group.count * max(0, 50 - day);
+        forecast.arrived += group.count;
+        group.count = 0;
+    };
+
+    for (int day = 1; day <= days && !groups.empty(); day++) {
+        for (auto &group: groups) {
+            int exit = field.teleporter_exit(group.at);
+            int here = group.distance(group.at);
+            if (exit < 0 || here >= UNREACHABLE_DISTANCE || group.distance(exit) > here)
+                continue;
+            group.at = exit;
+            if (group.distance(exit) == 0)
+                land(group, day - 1);
+        }
+
+        std::fill(moving.begin(), moving.end(), 0);
+        used.clear();
+        for (size_t p = 0; p < fleet.size(); p++) {
+            const t_route &route = *fleet[p].route;
+            if (route.size() < 2) continue;
+            next[p] = cursors[p].advanced(route);
+            auto key = tube_key(route[cursors[p].index], route[next[p].index]);
+            auto cap = capacity.find(key);
+            if (cap == capacity.end())
+                continue;
+            auto slot = std::lower_bound(used.begin(), used.end(), std::make_pair(key, 0));
+            if (slot == used.end() || slot->first != key)
+                slot = used.insert(slot, {key, 0});
+            if (slot->second < cap->second) {
+                slot->second++;
+                moving[p] = 1;
+            }
+        }
+
+        std::fill(seats.begin(), seats.end(), POD_CAPACITY);
+        boarded.clear();
+        at_stop.clear();
+        for (size_t p = 0; p < fleet.size(); p++)
+            if (moving[p])
+                at_stop.push_back({(*fleet[p].route)[cursors[p].index], p});
+        std::sort(at_stop.begin(), at_stop.end());
+        for (auto &group: groups) {
+            int here = group.distance(group.at);
+            auto it = std::lower_bound(at_stop.begin(), at_stop.end(), std::make_pair(group.at, (size_t)0));
+            for (; it != at_stop.end() && it->first == group.at && group.count > 0; ++it) {
+                size_t p = it->second;
+                if (seats[p] == 0)
+                    continue;
+                int to = (*fleet[p].route)[next[p].index];
+                if (group.distance(to) >= here)
+                    continue;
+                int n = min(seats[p], group.count);
+                seats[p] -= n;
+                group.count -= n;
+                boarded.push_back({group.pad, group.type, to, n, group.dist, 0});
+            }
+        }
+        for (auto &group: boarded) {
+            if (group.distance(group.at) == 0)
+                land(group, day);
+            else
+                groups.push_back(group);
+        }
+        groups.erase(std::remove_if(groups.begin(), groups.end(), [](const Group &g) { return g.count == 0; }), groups.end());
+        // By pad, equal pads in the order they were in (std::stable_sort would allocate)
+        for (size_t i = 0; i < groups.size(); i++)
+            groups[i].order = i;
+        std::sort(groups.begin(), groups.end(), [](const Group &a, const Group &b) {
+            return a.pad != b.pad ? a.pad < b.pad : a.order < b.order;
+        });
+
+        for (size_t p = 0; p < fleet.size(); p++)
+            if (moving[p])
+                cursors[p] = next[p];
+    }
+    std::sort(forecast.landings.begin(), forecast.landings.end());
+}
+
+ArrivalForecast predict_arrivals(const SimModel &model, const DistanceField &field, const std::vector<FleetPod> &fleet,
+    const std::map<std::pair<int, int>, int> &capacity, int days = DAYS_PER_MONTH)
+{
+    ArrivalScratch scratch;
+    ArrivalForecast forecast;
+    predict_arrivals(model, field, fleet, capacity, scratch, forecast, days);
+    return forecast;
+}
+
+ArrivalForecast predict_arrivals(const SimModel &model)
+{
+    return predict_arrivals(model, network_field(model), current_fleet(model), tube_capacities(model));
+}
+
+/**
+ * What valuing candidate links needs from the current network, built once per turn
+ * The scratch buffers keep their memory from one candidate to the next.
+ */
+struct LinkValuation {
+    DistanceField                           field;
+    std::vector<FleetPod>                   fleet;
+    std::map<std::pair<int, int>, int>      capacity;
+    ArrivalForecast                         base;           // Forecast without any new link
+    FlatSet<int>                            pads_with_pods; // Stops of the pods flying, pads included
+    std::vector<int>                        hops;           // Scratch of redirect_balance_gain
+    std::vector<int>                        level, next_level; // idem
+    std::vector<std::tuple<int, int, int>>  moved;          // (from hangout, to hangout, astronauts), idem
+    std::vector<FleetPod>                   trial_fleet;    // Scratch of marginal_speed_gain, assigned from fleet
+    t_route                                 shuttle;        // idem
+    ArrivalScratch                          arrivals;       // idem
+    ArrivalForecast                         with_link;      // idem
+
+    explicit LinkValuation(const SimModel &model)
+        : field(network_field(model)), fleet(current_fleet(model)), capacity(tube_capacities(model)),
+          base(predict_arrivals(model, field, fleet, capacity)) {
+        for (const auto &[id, pod]: model.pods)
+            for (int stop: pod->route)
+                pads_with_pods.insert(stop);
+        hops.reserve(MAX_BUILDINGS);
+        level.reserve(MAX_BUILDINGS);
+        next_level.reserve(MAX_BUILDINGS);
+        moved.reserve(model.buildings.size());
+        trial_fleet.reserve(fleet.size() + 1);
+        shuttle.reserve(3);
+    }
+
+    // Candidate tubes get a capacity of 0 (no pod goes through) now, trying one then only sets it
+    void expect_tubes(const t_actions &candidates) {
+        for (const auto &[b1, b2, link_type]: candidates)
+            if (link_type == T_TUBE)
+                capacity.try_emplace(tube_key(b1->id, b2->id), 0);
+    }
+};
+
+/**
+ * Speed points a link adds to the forecast without it over one month
+ * A new tube is ridden by a shuttle pod, the only way it moves anyone this month
+ */
+int marginal_speed_gain(const SimModel &model, LinkValuation &valuation, const Building *b1, const Building *b2, int link_type)
+{
+    if (b1->id >= MAX_BUILDINGS || b2->id >= MAX_BUILDINGS)
+        return 0;
+    DistanceField &field = valuation.field;
+    std::vector<FleetPod> &fleet = valuation.trial_fleet;
+    fleet = valuation.fleet;
+    t_route &shuttle = valuation.shuttle;
+    shuttle.assign({b1->id, b2->id, b1->id});
+    auto key = tube_key(b1->id, b2->id);
+    auto had = valuation.capacity.find(key);
+    int was = had == valuation.capacity.end() ? -1 : had->second;
+    field.begin_trial();
+    if (link_type == T_TELE)
+        field.add_teleporter(b1->id, b2->id);
+    else {
+        field.add_tube(b1->id, b2->id);
+        valuation.capacity[key] = 1;
+        fleet.push_back({Pod::next_id(), &shuttle});
+    }
+    predict_arrivals(model, field, fleet, valuation.capacity, valuation.arrivals, valuation.with_link);
+    field.end_trial();
+    int gain = valuation.with_link.speed_points - valuation.base.speed_points;
+    if (link_type != T_TELE) {
+        if (was < 0)
+            valuation.capacity.erase(key);
+        else
+            valuation.capacity[key] = was;
+    }
+    return gain;
+}
+
+/**
+ * Balance points a link adds by sending cohorts to the hangout at its far end
+ * A cohort of `to`'s type moves there when `to` gets strictly closer than the nearest module
+ * of its type today. Each move is an O(1) delta on the forecast's BalanceModel, undone after.
+ */
+int redirect_balance_gain(const SimModel &model, LinkValuation &valuation, const Building *from, const Building *to, int link_type)
+{
+    if (to->building_class != BuildingClass::HANGOUT || from->id >= MAX_BUILDINGS)
+        return 0;
+    int hop = link_type == T_TELE ? 0 : 1;
+    ArrivalForecast &base = valuation.base;
+    std::vector<int> &hops = valuation.hops;
+    if (from->city != nullptr)
+        from->city->distances.hops_from(from->id, hops, valuation.level, valuation.next_level);
+    else {
+        hops.assign(MAX_BUILDINGS, UNREACHABLE_DISTANCE);
+        hops[from->id] = 0;
+    }
+
+    std::vector<std::tuple<int, int, int>> &moved = valuation.moved;
+    moved.clear();
+    int gain = 0;
+    for (const auto &[id, building]: model.buildings) {
+        if (building->building_class != BuildingClass::PAD || id >= MAX_BUILDINGS || hops[id] >= UNREACHABLE_DISTANCE)
+            continue;
+        int count = static_cast<const LandingPad*>(building)->get_dudes().get_type_count(to->type);
+        if (count <= 0 || hops[id] + hop >= distance_to_type(building, to->type))
+            continue;
+        int was = base.destination_of(id, to->type);
+        gain += base.balance.redirect(was, to->id, count);
+        moved.push_back({was, to->id, count});
+    }
+    for (auto it = moved.rbegin(); it != moved.rend(); ++it)
+        base.balance.redirect(std::get<1>(*it), std::get<0>(*it), std::get<2>(*it));
+    return gain;
+}
+
+/**
+ * Points a link is expected to bring each month, summed over the astronaut types it helps:
+ * the days saved on the way to the nearest matching hangout, or most of the 100 points
+ * when the link is what makes the hangout reachable at all
+ */
+int estimate_link_value(const Building *from, const Building *to, int link_type)
+{
+    const Flow *flow = nullptr;
+    if (from->city != nullptr)
+        flow = &from->city->dudes;
+    else if (from->building_class == BuildingClass::PAD)
+        flow = &dynamic_cast<const LandingPad *>(from)->get_dudes();
+    if (flow == nullptr)
+        return 0;
+
+    int hop = link_type == T_TELE ? 0 : 1;
+    int value = 0;
+    for (const auto &[type, count]: flow->data) {
+        if (count <= 0) continue;
+        int now = from->city ? from->city->distances.distance(type, from->id) : UNREACHABLE_DISTANCE;
+        int there = to->type == type ? 0 : (to->city ? to->city->distances.distance(type, to->id) : UNREACHABLE_DISTANCE);
+        if (there >= UNREACHABLE_DISTANCE || there + hop >= now)
+            continue;
+        int via = there + hop;
+        value += count * (now >= UNREACHABLE_DISTANCE ? 100 - via : now - via);
+    }
+    return value;
+}
+
+// Two tubes that join the same buildings or cross, or two teleporters sharing a building
+bool links_clash(const std::tuple<Building*, Building*, int> &a, const std::tuple<Building*, Building*, int> &b)
+{
+    const auto &[a1, a2, ta] = a;
+    const auto &[b1, b2, tb] = b;
+    if (ta == T_TELE && tb == T_TELE)
+        return a1 == b1 || a1 == b2 || a2 == b1 || a2 == b2;
+    if (ta == T_TUBE && tb == T_TUBE)
+        return (a1 == b1 && a2 == b2) || (a1 == b2 && a2 == b1)
+            || will_overlap_tube(a1->get_pos(), a2->get_pos(), b1->get_pos(), b2->get_pos());
+    return false;
+}
+
+/**
+ * One candidate action for the knapsack, `cost` includes the pod it will need
+ */
+struct KnapsackItem {
+    size_t  index;  // In the suggested links
+    int     cost;
+    int     value;
+};
+
+/**
+ * 0/1 knapsack by branch and bound: maximise the summed value under `budget`
+ * Items are explored by decreasing value density, the bound is the fractional relaxation.
+ * Two tubes that cross and two teleporters sharing a building are never picked together.
+ * Gives up on optimality after `node_limit` nodes and returns the best set seen.
+ */
+std::vector<size_t> knapsack_select(std::vector<KnapsackItem> items, const t_actions &links, int budget, size_t node_limit = 20000)
+{
+    std::sort(items.begin(), items.end(), [](const KnapsackItem &a, const KnapsackItem &b) {
+        return (long long)a.value * max(1, b.cost) > (long long)b.value * max(1, a.cost);
+    });
+    size_t n = items.size();
+
+    std::vector<std::vector<char>> conflict(n, std::vector<char>(n, 0));
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = i + 1; j < n; j++)
+            conflict[i][j] = conflict[j][i] = links_clash(links[items[i].index], links[items[j].index]);
+
+    std::vector<size_t> chosen, best_chosen;
+    int best_value = 0;
+    size_t nodes = 0;
+
+    auto bound = [&](size_t from, int value, int room) {
+        double b = value;
+        for (size_t i = from; i < n && room > 0; i++) {
+            if (items[i].cost <= room) { room -= items[i].cost; b += items[i].value; }
+            else { b += (double)items[i].value * room / max(1, items[i].cost); break; }
+        }
+        return b;
+    };
+
+    std::function<void(size_t, int, int)> branch = [&](size_t i, int value, int room) {
+        if (value > best_value) {
+            best_value = value;
+            best_chosen = chosen;
+        }
+        if (i >= n || ++nodes > node_limit || bound(i, value, room) <= best_value)
+            return;
+        bool fits = items[i].cost <= room;
+        for (size_t c : chosen)
+            if (conflict[i][c]) fits = false;
+        if (fits) {
+            chosen.push_back(i);
+            branch(i + 1, value + items[i].value, room - items[i].cost);
+            chosen.pop_back();
+        }
+        branch(i + 1, value, room);
+    };
+    branch(0, 0, budget);
+
+    std::vector<size_t> result;
+    for (size_t i : best_chosen)
+        result.push_back(items[i].index);
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+// Family of a candidate link, the bandit learns per family
+int link_arm(const Building *b1, const Building *b2, int link_type)
+{
+    int category;
+    if (link_type == T_TELE)
+        category = CAT_TELEPORTER;
+    else if (b1->city != nullptr && b2->city != nullptr && b1->city != b2->city)
+        category = CAT_CITY_MERGE;
+    else if (b1->building_class == BuildingClass::PAD || b2->building_class == BuildingClass::PAD) {
+        const Building *pad = b1->building_class == BuildingClass::PAD ? b1 : b2;
+        const Building *other = pad == b1 ? b2 : b1;
+        bool match = other->building_class == BuildingClass::HANGOUT
+            && static_cast<const LandingPad*>(pad)->get_dudes().has_type(other->type);
+        category = match ? CAT_PAD_TO_MATCH : CAT_PAD_TO_OTHER;
+    } else
+        category = CAT_CITY_EXTEND;
+    return LinkBandit::arm(category, b1->get_pos().distance(b2->get_pos()));
+}
+
+/*
+Returns the best affordable set amongst a draw of approximately target_sample_width links
+The draw favours the link families the bandit rates best (weighted sampling without replacement)
+*/
+t_actions    sample_links(const t_actions &suggested_links, size_t target_sample_width, int budget, const SimModel &model,
+    LinkValuation &valuation)
+{
+    if (target_sample_width > (size_t)params().sample_width_limit)
+        target_sample_width = params().sample_width_cap;
+
+    static std::random_device rd;
+    static std::mt19937 rng(rd());
+    // Efraimidis-Spirakis keys: u^(1/w), the largest keys make the draw
+    std::vector<std::pair<double, int>> keyed;
+    for (size_t i = 0; i < suggested_links.size(); i++) {
+        const auto &[b1, b2, link_type] = suggested_links[i];
+        double weight = model.bandit.ucb(link_arm(b1, b2, link_type));
+        double u = std::uniform_real_distribution<double>(1e-12, 1.0)(rng);
+        keyed.push_back({std::pow(u, 1.0 / weight), (int)i});
+    }
+    std::sort(keyed.rbegin(), keyed.rend());
+    std::vector<int> indices;
+    for (const auto &[key, i]: keyed)
+        indices.push_back(i);
+
+    size_t max_samples = min(2 * target_sample_width, suggested_links.size());
+    std::vector<KnapsackItem> items;
+    for (size_t i = 0; i < max_samples; i++) {
+        const auto &[b1, b2, link_type] = suggested_links[indices[i]];
+        auto planned = model.teleporter_gains.find({b1->id, b2->id});
+        int value = link_type == T_TELE && planned != model.teleporter_gains.end() ? planned->second : estimate_link_value(b1, b2, link_type);
+        if (link_type == T_TUBE)
+            value += estimate_link_value(b2, b1, link_type);
+        // Hop counts price reachability, the forecast adds how fast pods will actually get them there
+        value += max(0, marginal_speed_gain(model, valuation, b1, b2, link_type));
+        // and how much less crowded the modules they reach are
+        value += redirect_balance_gain(model, valuation, b1, b2, link_type);
+        if (link_type == T_TUBE)
+            value += redirect_balance_gain(model, valuation, b2, b1, link_type);
+        if (value <= 0)
+            continue;
+        int cost = action_cost(b1, b2, link_type);
+        // A tube is useless without a pod going through it
+        if (link_type == T_TUBE && !valuation.pads_with_pods.count(b1->id) && !valuation.pads_with_pods.count(b2->id))
+            cost += (int)(POD_PRICE * params().unserved_tube_pod_share);
+        items.push_back({(size_t)indices[i], cost, value * (20 - max(0, model.round))});
+    }
+
+    t_actions sampled_links;
+    for (size_t index: knapsack_select(items, suggested_links, budget))
+        sampled_links.push_back(suggested_links[index]);
+    return sampled_links;
+}
+
+/**
+ * Score of a relevant building found `depth` hops away from the pad
+ * route_top_weight for a direct neighbour, route_hop_penalty less per extra hop, never below 1
+ */
+inline int route_depth_weight(int depth) {
+    return max(1, params().route_top_weight - params().route_hop_penalty * (depth - 1));
+}
+
+/**
+ * Best route found from one neighbour of the pad
+ * `stops` excludes the pad, `closed` routes come back through another tube instead of retracing
+ */
+struct RouteBranch {
+    int                                             score = 0;
+    int                                             length = 0; // Tubes travelled for a full cycle
+    bool                                            closed = false;
+    SmallVector<const Building*, MAX_ROUTE_DEPTH>   stops;
+};
+
+/**
+ * The links a route search may use, by building id
+ * Rebuilding it for another link space only clears the buildings the previous one touched,
+ * so planning design after design does not allocate once the adjacency lists have grown.
+ */
+class RouteGraph {
+    static const std::vector<const Building*> no_neighbors;
+
+    std::vector<std::vector<const Building*>>   tubes = std::vector<std::vector<const Building*>>(MAX_BUILDINGS);
+    std::vector<const Building*>                tp_exits = std::vector<const Building*>(MAX_BUILDINGS, nullptr);
+    std::vector<int>                            touched;    // Ids with a link
+    std::vector<const LandingPad*>              pad_list;   // Pads with a tube, by id
+
+public:
+    void build(const std::vector<Link*> &link_space) {
+        for (int id: touched) {
+            tubes[id].clear();
+            tp_exits[id] = nullptr;
+        }
+        touched.clear();
+        pad_list.clear();
+        for (const Link *link: link_space) {
+            if (link->b1->id >= MAX_BUILDINGS || link->b2->id >= MAX_BUILDINGS)
+                continue;
+            touched.push_back(link->b1->id);
+            touched.push_back(link->b2->id);
+            if (link->id < 0) {
+                tp_exits[link->b1->id] = link->b2;
+                continue;
+            }
+            for (const Building *end: {link->b1, link->b2}) {
+                const Building *other = end == link->b1 ? link->b2 : link->b1;
+                if (tubes[end->id].empty() && end->building_class == BuildingClass::PAD)
+                    pad_list.push_back(static_cast<const LandingPad*>(end));
+                tubes[end->id].push_back(other);
+            }
+        }
+        std::sort(pad_list.begin(), pad_list.end(), [](const LandingPad *a, const LandingPad *b) { return a->id < b->id; });
+    }
+
+    const std::vector<const Building*> &neighbors(const Building *b) const {
+        return b->id < MAX_BUILDINGS ? tubes[b->id] : no_neighbors;
+    }
+
+    // Teleporters already carry dudes from their entrance to the exit, no pod needed
+    bool has_teleporter(const Building *from, const Building *to) const {
+        return from->id < MAX_BUILDINGS && tp_exits[from->id] == to;
+    }
+
+    const std::vector<const LandingPad*> &pads() const { return pad_list; }
+};
+
+const std::vector<const Building*> RouteGraph::no_neighbors;
+
+/**
+ * Iterative depth-first enumeration of the simple paths leaving `origin`, up to MAX_ROUTE_DEPTH hops
+ * Keeps, for each first hop, the path with the best score (then the shortest cycle)
+ * Branches whose score cannot beat the best one even if every remaining hop is relevant are pruned
+ * The branches are written to `branches`, cleared first, so callers can reuse its memory
+ */
+void enumerate_route_branches(const Building *origin, const Flow &inflow, const RouteGraph &graph,
+    std::vector<RouteBranch> &branches)
+{
+    struct Frame {
+        const Building*                         building;
+        const std::vector<const Building*>*     neighbors;
+        size_t                                  next;
+        int                                     score;
+    };
+
+    int remaining_bound[MAX_ROUTE_DEPTH + 2] = {0};
+    for (int depth = MAX_ROUTE_DEPTH; depth >= 1; depth--)
+        remaining_bound[depth] = remaining_bound[depth + 1] + route_depth_weight(depth);
+
+    branches.clear();
+    if (origin->id >= MAX_BUILDINGS)
+        return;
+    branches.reserve(MAX_TUBES_PER_BUILDING); // One per tube leaving the pad
+    Frame stack[MAX_ROUTE_DEPTH + 1];
+    t_visited visited;
+    int top = 0;
+
+    stack[0] = {origin, &graph.neighbors(origin), 0, 0};
+    visited.set(origin->id);
+
+    while (top >= 0) {
+        Frame &frame = stack[top];
+        if (frame.next >= frame.neighbors->size()) {
+            visited.reset(frame.building->id);
+            top--;
+            continue;
+        }
+        const Building *next = (*frame.neighbors)[frame.next++];
+        if (next == nullptr || next->id >= MAX_BUILDINGS || graph.has_teleporter(frame.building, next))
+            continue;
+
+        int depth = top + 1;
+        if (top == 0)
+            branches.emplace_back();
+        RouteBranch &branch = branches.back();
+
+        // Back at the origin through another tube: a loop, no need to retrace
+        if (next == origin) {
+            if (depth >= 3 && frame.score > 0 && (frame.score > branch.score || (frame.score == branch.score && depth < branch.length))) {
+                branch = {frame.score, depth, true, {}};
+                for (int k = 1; k <= top; k++)
+                    branch.stops.push_back(stack[k].building);
+            }
+            continue;
+        }
+        if (visited.test(next->id))
+            continue;
+
+        int score = frame.score + (inflow.has_type(next->type) ? route_depth_weight(depth) : 0);
+        if (score > 0 && (score > branch.score || (score == branch.score && 2 * depth < branch.length))) {
+            branch = {score, 2 * depth, false, {}};
+            for (int k = 1; k <= top; k++)
+                branch.stops.push_back(stack[k].building);
+            branch.stops.push_back(next);
+        }
+        if (depth >= MAX_ROUTE_DEPTH || score + remaining_bound[depth + 1] <= branch.score)
+            continue;
+
+        visited.set(next->id);
+        stack[++top] = {next, &graph.neighbors(next), 0, score};
+    }
+}
+
+/**
+ * Buffers of make_paths, kept by the caller so planning design after design does not allocate
+ */
+struct PathScratch {
+    RouteGraph                  graph;
+    std::vector<RouteBranch>    branches;
+    std::vector<t_route>        spare;      // Routes of a longer plan, kept for the next ones
+};
+
+/*
+    Find the best combinaison of routes using the available links
+    Every pad gets one cyclic route touring the best branch behind each of its tubes
+
+    Writes (score, routes) over `selected_routes`, whose routes keep their memory
+*/
+void make_paths(const std::vector<Link*> &link_space, const t_DudeSupplyChain &supply_chain, int budget, const SimModel& model,
+    PathScratch &scratch, t_routes_and_scores &selected_routes)
+{
+    size_t found = 0;
+    if (budget <= 0) {
+        selected_routes.clear();
+        return;
+    }
+
+    // This is what can be used
+    scratch.graph.build(link_space);
+
+    std::vector<RouteBranch> &branches = scratch.branches;
+    for (const LandingPad *working_pad: scratch.graph.pads()) {
+        // Start every routes from a pad
+        if (found == selected_routes.size()) {
+            selected_routes.emplace_back();
+            if (!scratch.spare.empty()) {
+                selected_routes.back().second = std::move(scratch.spare.back());
+                scratch.spare.pop_back();
+            }
+        }
+        auto &[score, route] = selected_routes[found];
+        score = 0;
+        route.clear();
+        route.push_back(working_pad->id);
+
+        enumerate_route_branches(working_pad, working_pad->get_dudes(), scratch.graph, branches);
+        for (const auto &branch: branches) {
+            if (branch.score == 0)
+                continue;
+            score += branch.score;
+            for (const auto &stop: branch.stops)
+                route.push_back(stop->id);
+            if (!branch.closed) // Retrace back to the pad
+                for (auto it = branch.stops.rbegin() + 1; it != branch.stops.rend(); ++it)
+                    route.push_back((*it)->id);
+            route.push_back(working_pad->id);
+        }
+        if (route.size() < 2) continue; // No route found
+        found++;
+    }
+    for (; selected_routes.size() > found; selected_routes.pop_back())
+        scratch.spare.push_back(std::move(selected_routes.back().second));
+}
+
+// Same, returns (score, routes)
+t_routes_and_scores make_paths(const std::vector<Link*> &link_space, const t_DudeSupplyChain &supply_chain, int budget, const SimModel& model)
+{
+    PathScratch scratch;
+    t_routes_and_scores selected_routes;
+    make_paths(link_space, supply_chain, budget, model, scratch, selected_routes);
+    return selected_routes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// PARALLEL PLANNING
+
+#define MIN_LINKS_PER_THREAD 8 // Smaller cities are planned inline, a thread costs more than their search
+
+/**
+ * Runs task(i) for every i < n, spread over the cores when there are several
+ * Tasks must not touch shared state, each writes to its own slot
+ */
+template <typename Task>
+void parallel_for(size_t n, Task task)
+{
+    size_t workers = min(n, (size_t)max(1, (int)std::thread::hardware_concurrency()));
+    if (workers <= 1) {
+        for (size_t i = 0; i < n; i++)
+            task(i);
+        return;
+    }
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> pool;
+    for (size_t w = 1; w < workers; w++)
+        pool.emplace_back([&]() { for (size_t i; (i = next++) < n;) task(i); });
+    for (size_t i; (i = next++) < n;)
+        task(i);
+    for (auto &thread: pool)
+        thread.join();
+}
+
+/**
+ * make_paths for each city of the overlay on its own
+ * Cities share no tube, so a pad's routes never leave its city: the link space is split by
+ * component and the big ones are searched in parallel. Routes come back city by city.
+ */
+t_routes_and_scores make_paths_by_city(const ModelOverlay &overlay, const t_DudeSupplyChain &supply_chain, int budget, SimModel &model)
+{
+    std::map<int, std::vector<Link*>> by_city;
+    for (Link *link: overlay.links())
+        by_city[overlay.component(link->b1->id)].push_back(link);
+
+    std::vector<const std::vector<Link*>*> big, small;
+    for (const auto &[city, links]: by_city)
+        (links.size() >= MIN_LINKS_PER_THREAD ? big : small).push_back(&links);
+
+    std::vector<t_routes_and_scores> routes(big.size() + small.size());
+    parallel_for(big.size(), [&](size_t i) { routes[i] = make_paths(*big[i], supply_chain, budget, model); });
+    for (size_t i = 0; i < small.size(); i++)
+        routes[big.size() + i] = make_paths(*small[i], supply_chain, budget, model);
+
+    t_routes_and_scores all;
+    for (auto &city_routes: routes)
+        all.insert(all.end(), city_routes.begin(), city_routes.end());
+    return all;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// PARETO FRONTIER
+
+/**
+ * What one resource kept this month is worth at the end of the game
+ *
+ * Resources left count in the final score and earn interest every month until then,
+ * so spending one now must pay back more than its compounded value.
+ */
+double resource_value(int round)
+{
+    return std::pow(1.0 + MONTHLY_INTEREST_PERCENT / 100.0,
+        params().resource_interest_weight * max(0, MAP_MONTHS_LEFT(round) - 1));
+}
+
+/**
+ * Action sets that no other beats on both price and predicted gain, cheapest first
+ */
+template <typename T>
+class ParetoFrontier {
+public:
+    struct Point {
+        int         cost;
+        long long   gain;
+        T           item;
+    };
+
+    // Returns false when an existing point dominates the new one
+    bool insert(int cost, long long gain, T item) {
+        auto it = std::lower_bound(points.begin(), points.end(), cost,
+            [](const Point &point, int c) { return point.cost < c; });
+        // Anything as cheap with at least this gain dominates it
+        if (it != points.begin() && std::prev(it)->gain >= gain)
+            return false;
+        if (it != points.end() && it->cost == cost && it->gain >= gain)
+            return false;
+        // Then it dominates the pricier points that gain no more
+        auto end = it;
+        while (end != points.end() && end->gain <= gain)
+            end++;
+        it = points.erase(it, end);
+        points.insert(it, Point{cost, gain, item});
+        return true;
+    }
+
+    // The point with the best gain once each resource spent is charged `price`
+    const Point *select(double price) const {
+        const Point *best = nullptr;
+        double best_value = 0;
+        for (const auto &point: points) {
+            double value = point.gain - price * point.cost;
+            if (best == nullptr || value > best_value) {
+                best = &point;
+                best_value = value;
+            }
+        }
+        return best;
+    }
+
+    const std::vector<Point> &get_points() const { return points; }
+    size_t size() const { return points.size(); }
+
+private:
+    std::vector<Point> points;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// SCREENING
+
+/**
+ * Points a network earns at best in one month, from type coverage and hop counts
+ *
+ * Every astronaut whose type is reachable in its city lands as early as the hops allow,
+ * read from the field when given, else one day (a pad is never a module, only a teleporter
+ * gets it there on day 0). The arrivals of a type then spread evenly over the modules of
+ * their city, the most balance points they can make. No pod schedule beats it.
+ * The pad cohorts are listed once per model, a bound is then one pass over them.
+ */
+class OptimisticPoints {
+    struct Cohort {
+        const Building  *pad;
+        int             type, count;
+    };
+    std::vector<Cohort>                     cohorts;    // Pad by pad
+    int                                     types = 1;  // Cohort type ids are below it
+    std::vector<const std::vector<int>*>    to_type;    // Distances of the field by type, scratch
+    std::vector<int>                        arrivals;   // Astronauts by city then type, scratch left at 0
+    std::vector<int>                        tallied;    // Indices of arrivals in use, scratch
+
+public:
+    explicit OptimisticPoints(const SimModel &model) {
+        for (const auto &[id, building]: model.buildings) {
+            if (building->building_class != BuildingClass::PAD || id >= MAX_BUILDINGS)
+                continue;
+            for (const auto &[type, count]: static_cast<const LandingPad*>(building)->get_dudes().data)
+                if (count > 0) {
+                    cohorts.push_back({building, type, (int)count});
+                    types = max(types, type + 1);
+                }
+        }
+        to_type.resize(types);
+        tallied.reserve(cohorts.size());
+    }
+
+    long long operator()(const ModelOverlay &overlay, const DistanceField *field) {
+        long long points = 0;
+        if (field != nullptr)
+            for (int type = 0; type < types; type++)
+                to_type[type] = field->distances(type);
+        arrivals.resize((size_t)overlay.components() * types, 0);
+        const Building *pad_seen = nullptr;
+        int city = 0;
+        for (const auto &[pad, type, count]: cohorts) {
+            if (pad != pad_seen) {
+                pad_seen = pad;
+                city = overlay.component(pad->id);
+            }
+            if (overlay.hangouts_in(city, type) == 0)
+                continue;
+            int day = field == nullptr ? (overlay.tp_state(pad) == TeleporterState::Eingang ? 0 : 1)
+                : to_type[type] != nullptr ? (*to_type[type])[pad->id] : UNREACHABLE_DISTANCE;
+            if (day >= UNREACHABLE_DISTANCE)
+                continue;
+            points += (long long)count * max(0, 50 - day);
+            int at = city * types + type;
+            if (arrivals[at] == 0)
+                tallied.push_back(at);
+            arrivals[at] += count;
+        }
+        for (int at: tallied) {
+            int n = arrivals[at], modules = overlay.hangouts_in(at / types, at % types);
+            points += (long long)(n % modules) * balance_points(n / modules + 1)
+                + (long long)(modules - n % modules) * balance_points(n / modules);
+            arrivals[at] = 0;
+        }
+        tallied.clear();
+        return points;
+    }
+};
+
+/**
+ * The cheap tests a design of the genetic search goes through before make_paths plans it
+ *
+ * Values are points over the months left minus the price of the links, as in the race.
+ * The incumbent starts as the current network forecast over the full month, and rises each
+ * time the island's best design, forecast the same way with its routes, does better.
+ * A design whose optimistic value cannot beat it is dropped, first on coverage alone (off
+ * the overlay), then on the hop counts of its distance field. The hop bound of the others
+ * ranks the designs of a generation.
+ * Each island has its own copy: designs are loaded in its field as a trial, the fleet,
+ * capacities and forecast are its scratch buffers, so screening a design does not allocate.
+ */
+class DesignScreen {
+    const SimModel&                     model;
+    OptimisticPoints                    optimistic;
+    DistanceField                       field;
+    std::vector<FleetPod>               fleet;
+    std::map<std::pair<int, int>, int>  capacity;
+    int                                 months_left;
+    double                              price;
+    double                              incumbent;
+    std::vector<FleetPod>               trial_fleet; // Scratch, assigned from fleet
+    std::vector<int*>                   opened;     // Capacities of the new tubes set to 1 by raise_incumbent(), idem
+    ArrivalScratch                      arrivals;   // idem
+    ArrivalForecast                     result;     // idem
+
+public:
+    struct Counts {
+        long long   considered = 0;     // Designs repaired to something new
+        long long   by_coverage = 0;    // Dropped on the coverage bound
+        long long   by_hops = 0;        // Dropped on the hop bound
+        long long   by_rank = 0;        // Left out of make_paths, in the worse half on the hop bound
+        long long   planned = 0;        // Planned by make_paths
+
+        Counts &operator+=(const Counts &other) {
+            considered += other.considered;
+            by_coverage += other.by_coverage;
+            by_hops += other.by_hops;
+            by_rank += other.by_rank;
+            planned += other.planned;
+            return *this;
+        }
+    };
+
+    // The suggested tubes get a capacity of 0 (no pod goes through) until raise_incumbent opens them
+    DesignScreen(const SimModel &model, const t_actions &links)
+        : model(model), optimistic(model), field(network_field(model)), fleet(current_fleet(model)), capacity(tube_capacities(model)),
+          months_left(max(1, MAP_MONTHS_LEFT(model.round))), price(resource_value(model.round))
+    {
+        predict_arrivals(model, field, fleet, capacity, arrivals, result);
+        incumbent = (double)(result.speed_points + result.balance.score()) * months_left;
+        for (const auto &[b1, b2, link_type]: links)
+            if (link_type == T_TUBE)
+                capacity.try_emplace(tube_key(b1->id, b2->id), 0);
+        trial_fleet.reserve(fleet.size());
+        opened.reserve(links.size());
+    }
+
+    double value(long long month_points, int cost) const { return (double)month_points * months_left - price * cost; }
+
+    // The overlay holds the design: can it beat the incumbent on type coverage alone?
+    bool passes_coverage(const ModelOverlay &overlay, int cost) {
+        return value(optimistic(overlay, nullptr), cost) > incumbent;
+    }
+
+    // Load the design's links in the field until unload(), the calls in between run on it
+    void load(const t_actions &links, const std::vector<char> &genome) {
+        field.begin_trial();
+        for (size_t i = 0; i < links.size(); i++) {
+            const auto &[b1, b2, link_type] = links[i];
+            if (!genome[i] || b1->id >= MAX_BUILDINGS || b2->id >= MAX_BUILDINGS)
+                continue;
+            if (link_type == T_TELE)
+                field.add_teleporter(b1->id, b2->id);
+            else
+                field.add_tube(b1->id, b2->id);
+        }
+    }
+
+    void unload() {
+        field.end_trial();
+        for (int *tube_capacity: opened)
+            *tube_capacity = 0;
+        opened.clear();
+    }
+
+    // Can the loaded design (also in the overlay) beat the incumbent on hop counts? `bound` gets its value
+    bool passes_hops(const ModelOverlay &overlay, int cost, double &bound) {
+        bound = value(optimistic(overlay, &field), cost);
+        return bound > incumbent;
+    }
+
+    // Forecast the loaded design over the full month with one pod per route, its new tubes opened
+    void raise_incumbent(const t_actions &links, const std::vector<char> &genome, const t_routes_and_scores &routes, int cost) {
+        for (size_t i = 0; i < links.size(); i++) {
+            const auto &[b1, b2, link_type] = links[i];
+            if (!genome[i] || link_type != T_TUBE)
+                continue;
+            int &tube_capacity = capacity[tube_key(b1->id, b2->id)];
+            if (tube_capacity == 0) {
+                tube_capacity = 1;
+                opened.push_back(&tube_capacity);
+            }
+        }
+        trial_fleet = fleet;
+        int id = Pod::next_id();
+        for (const auto &[score, route]: routes)
+            if (score > 0 && route.size() >= 3)
+                trial_fleet.push_back({id++, &route});
+        predict_arrivals(model, field, trial_fleet, capacity, arrivals, result);
+        incumbent = std::max(incumbent, value(result.speed_points + result.balance.score(), cost));
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// GENETIC SEARCH
+
+#define SEARCH_BUDGET_MS 150        // Wall time the network design search may use each turn
+#define SEARCH_ISLANDS 4
+#define SEARCH_POPULATION 12        // Designs per island
+#define SEARCH_MIGRATION_EVERY 5    // Generations between two migrations
+#define SEARCH_STALL_GENERATIONS 30 // An island stops after this many generations without progress
+#define SEARCH_POOL_SIZE 8          // Designs carried over to the next turn
+#define SEARCH_BROOD 44             // Offspring bred per generation and island
+#define SEARCH_ELITE 16             // Best designs an island planned that go to the race
+
+/**
+ * Which suggested links cannot be built together, worked out once per search
+ *
+ * A link the current network rules out, or that costs more than the resources, is never
+ * kept. Of the others, two tubes joining the same buildings or crossing conflict, and so do
+ * two teleporters sharing a building (links_clash). Repairing a design is then one bitset
+ * test per link, the decision ModelOverlay::apply would make applying them in order:
+ * only the tubes per building and the budget are counted as the links are kept.
+ */
+class LinkConflicts {
+    const t_actions&        links;
+    size_t                  words;      // 64-bit words per row
+    std::vector<uint64_t>   conflicts;  // Bit j of row i: links i and j cannot both be built
+    std::vector<int>        costs;
+    std::vector<char>       buildable;
+    std::vector<int>        base_tubes; // Tubes of the current network by building id
+    int                     resources;
+
+public:
+    // Caller-owned buffers of repair(), zeroed between calls
+    struct Scratch {
+        std::vector<uint64_t>   kept;
+        std::vector<int>        tubes;  // Tubes kept by building id
+    };
+
+    LinkConflicts(const SimModel &model, const t_actions &links)
+        : links(links), words((links.size() + 63) / 64), conflicts(links.size() * words, 0), costs(links.size()),
+          buildable(links.size()), base_tubes(MAX_BUILDINGS, 0), resources(model.resources)
+    {
+        ModelOverlay overlay(model);
+        for (size_t i = 0; i < links.size(); i++) {
+            const auto &[b1, b2, link_type] = links[i];
+            size_t mark = overlay.mark();
+            buildable[i] = overlay.apply(b1, b2, link_type) == SUCCESS;
+            overlay.rollback(mark);
+            if (!buildable[i])
+                continue;
+            costs[i] = action_cost(b1, b2, link_type);
+            for (size_t j = 0; j < i; j++)
+                if (buildable[j] && links_clash(links[i], links[j])) {
+                    conflicts[i * words + j / 64] |= 1ull << (j % 64);
+                    conflicts[j * words + i / 64] |= 1ull << (i % 64);
+                }
+        }
+        for (int id = 0; id < MAX_BUILDINGS; id++)
+            base_tubes[id] = model.tubes_at(id);
+    }
+
+    Scratch scratch() const { return {std::vector<uint64_t>(words, 0), std::vector<int>(MAX_BUILDINGS, 0)}; }
+
+    // Clear the genes of the links that cannot be built alongside the earlier ones, returns the cost
+    int repair(std::vector<char> &genome, Scratch &scratch) const {
+        int cost = 0;
+        for (size_t i = 0; i < links.size(); i++) {
+            if (!genome[i])
+                continue;
+            const auto &[b1, b2, link_type] = links[i];
+            bool fits = buildable[i] && cost + costs[i] <= resources;
+            for (size_t w = 0; fits && w < words; w++)
+                fits = (conflicts[i * words + w] & scratch.kept[w]) == 0;
+            if (fits && link_type == T_TUBE)
+                fits = base_tubes[b1->id] + scratch.tubes[b1->id] < MAX_TUBES_PER_BUILDING
+                    && base_tubes[b2->id] + scratch.tubes[b2->id] < MAX_TUBES_PER_BUILDING;
+            if (!fits) {
+                genome[i] = 0;
+                continue;
+            }
+            cost += costs[i];
+            scratch.kept[i / 64] |= 1ull << (i % 64);
+            if (link_type == T_TUBE) {
+                scratch.tubes[b1->id]++;
+                scratch.tubes[b2->id]++;
+            }
+        }
+        std::fill(scratch.kept.begin(), scratch.kept.end(), 0);
+        for (size_t i = 0; i < links.size(); i++)
+            if (genome[i] && std::get<2>(links[i]) == T_TUBE) {
+                scratch.tubes[std::get<0>(links[i])->id] = 0;
+                scratch.tubes[std::get<1>(links[i])->id] = 0;
+            }
+        return cost;
+    }
+};
+
+/**
+ * One island: a population of link subsets (one bit per suggested link) evolving on its own thread
+ *
+ * Designs are repaired on evaluation (LinkConflicts): going through the links in order,
+ * the ones crossing a previous tube, reusing a teleporter end or over budget are cleared,
+ * so every design in the population is buildable. Fitness is the summed route score
+ * make_paths gives the network, cheaper designs win ties.
+ * Each generation breeds SEARCH_BROOD offspring. They go through the DesignScreen first:
+ * only the ones left by the bounds, and of those the better half on the hop bound, are
+ * planned by make_paths.
+ */
+class DesignIsland {
+public:
+    typedef std::vector<char> t_genome;
+
+    struct Individual {
+        t_genome                genome;
+        long long               fitness = -1;
+        t_routes_and_scores     routes;
+        double                  screened = 0;   // Hop bound value, for offspring
+    };
+
+private:
+    const SimModel&             model;
+    const t_actions&            links;
+    const t_DudeSupplyChain&    supply_chain;
+    const LinkConflicts&        conflicts;
+    LinkConflicts::Scratch      repairs;
+    ModelOverlay                overlay;
+    std::mt19937                rng;
+    std::vector<Individual>     population;
+    std::vector<Individual>     elite;  // Best designs planned here, each once, best first
+    std::map<t_genome, long long> seen; // Fitness of every design already evaluated, -1 if screened out
+    DesignScreen                screen;
+    DesignScreen::Counts        counts;
+    PathScratch                 paths;
+
+    std::mutex                  inbox_lock;
+    std::vector<Individual>     inbox;  // Migrants from the previous island
+
+    // Put a repaired design on the overlay, taken back with rollback()
+    void build(const t_genome &genome) {
+        for (size_t i = 0; i < links.size(); i++)
+            if (genome[i])
+                overlay.apply_cleared(std::get<0>(links[i]), std::get<1>(links[i]), std::get<2>(links[i]));
+    }
+
+    void evaluate(Individual &individual) {
+        int cost = conflicts.repair(individual.genome, repairs);
+        size_t mark = overlay.mark();
+        build(individual.genome);
+        make_paths(overlay.links(), supply_chain, model.resources, model, paths, individual.routes);
+        overlay.rollback(mark);
+        long long score = 0;
+        for (const auto &[route_score, route]: individual.routes)
+            score += route_score;
+        individual.fitness = score * 100000 - cost;
+        seen[individual.genome] = individual.fitness;
+        counts.planned++;
+        enter_elite(individual);
+    }
+
+    void enter_elite(const Individual &individual) {
+        if (elite.size() >= SEARCH_ELITE && individual.fitness <= elite.back().fitness)
+            return;
+        for (const auto &member: elite)
+            if (member.genome == individual.genome)
+                return;
+        auto at = std::upper_bound(elite.begin(), elite.end(), individual,
+            [](const Individual &a, const Individual &b) { return a.fitness > b.fitness; });
+        elite.insert(at, individual);
+        if (elite.size() > SEARCH_ELITE)
+            elite.pop_back();
+    }
+
+    /**
+     * Repair an offspring and run it through the bounds
+     * Returns false if it repairs to a design already seen or cannot beat the incumbent,
+     * else its hop bound is in `screened`.
+     */
+    bool screen_offspring(Individual &individual) {
+        int cost = conflicts.repair(individual.genome, repairs);
+        if (seen.count(individual.genome))
+            return false;
+        counts.considered++;
+        seen[individual.genome] = -1;
+        size_t mark = overlay.mark();
+        build(individual.genome);
+        bool passed = false;
+        if (!screen.passes_coverage(overlay, cost))
+            counts.by_coverage++;
+        else {
+            screen.load(links, individual.genome);
+            passed = screen.passes_hops(overlay, cost, individual.screened);
+            counts.by_hops += !passed;
+            screen.unload();
+        }
+        overlay.rollback(mark);
+        return passed;
+    }
+
+    // The screen's incumbent follows the best design, genomes in the population are repaired already
+    void raise_incumbent() {
+        const Individual &best = population.front();
+        int cost = 0;
+        for (size_t i = 0; i < links.size(); i++)
+            if (best.genome[i])
+                cost += action_cost(std::get<0>(links[i]), std::get<1>(links[i]), std::get<2>(links[i]));
+        screen.load(links, best.genome);
+        screen.raise_incumbent(links, best.genome, best.routes, cost);
+        screen.unload();
+    }
+
+    const Individual &tournament() {
+        std::uniform_int_distribution<size_t> pick(0, population.size() - 1);
+        const Individual &a = population[pick(rng)], &b = population[pick(rng)];
+        return a.fitness >= b.fitness ? a : b;
+    }
+
+    // Uniform crossover, then flip a link in or out
+    Individual offspring() {
+        const Individual &a = tournament(), &b = tournament();
+        Individual child;
+        child.genome.resize(links.size());
+        uint32_t coins = 0;
+        for (size_t i = 0; i < links.size(); i++) {
+            if (i % 32 == 0)
+                coins = rng();
+            child.genome[i] = (coins >> (i % 32)) & 1 ? a.genome[i] : b.genome[i];
+        }
+        if (!links.empty())
+            child.genome[std::uniform_int_distribution<size_t>(0, links.size() - 1)(rng)] ^= 1;
+        return child;
+    }
+
+    void sort_population() {
+        std::sort(population.begin(), population.end(), [](const Individual &a, const Individual &b) { return a.fitness > b.fitness; });
+    }
+
+public:
+    DesignIsland(const SimModel &model, const t_actions &links, const t_DudeSupplyChain &supply_chain,
+        const LinkConflicts &conflicts, const DesignScreen &screen, uint32_t seed)
+    : model(model), links(links), supply_chain(supply_chain), conflicts(conflicts), repairs(conflicts.scratch()),
+      overlay(model), rng(seed), screen(screen) {}
+
+    void seed_with(const t_genome &genome) {
+        Individual individual;
+        individual.genome = genome;
+        evaluate(individual);
+        population.push_back(std::move(individual));
+    }
+
+    void receive(const Individual &migrant) {
+        std::lock_guard<std::mutex> guard(inbox_lock);
+        inbox.push_back(migrant);
+    }
+
+    const Individual &best() const { return population.front(); }
+    const std::vector<Individual> &best_planned() const { return elite; }
+    const DesignScreen::Counts &screen_counts() const { return counts; }
+
+    /**
+     * Evolve until the deadline or until the island stalls
+     * Every SEARCH_MIGRATION_EVERY generations the best design is sent to `next`
+     */
+    void run(std::chrono::steady_clock::time_point deadline, DesignIsland *next) {
+        while (population.size() < SEARCH_POPULATION) {
+            Individual random_design;
+            random_design.genome.resize(links.size());
+            for (auto &bit: random_design.genome)
+                bit = std::uniform_int_distribution<int>(0, 3)(rng) == 0;
+            evaluate(random_design);
+            population.push_back(std::move(random_design));
+        }
+        sort_population();
+        raise_incumbent();
+
+        long long best_fitness = population.front().fitness;
+        for (int generation = 1, stalled = 0; stalled < SEARCH_STALL_GENERATIONS; generation++, stalled++) {
+            if (std::chrono::steady_clock::now() >= deadline)
+                break;
+            std::vector<Individual> children;
+            for (int i = 0; i < SEARCH_BROOD; i++) {
+                Individual child = offspring();
+                if (screen_offspring(child))
+                    children.push_back(std::move(child));
+            }
+            // Only the better half on the hop bound is planned
+            std::sort(children.begin(), children.end(), [](const Individual &a, const Individual &b) { return a.screened > b.screened; });
+            size_t planned = (children.size() + 1) / 2;
+            counts.by_rank += children.size() - planned;
+            children.resize(planned);
+            for (auto &child: children)
+                evaluate(child);
+            {
+                std::lock_guard<std::mutex> guard(inbox_lock);
+                for (auto &migrant: inbox)
+                    children.push_back(std::move(migrant));
+                inbox.clear();
+            }
+            for (auto &child: children)
+                population.push_back(std::move(child));
+            sort_population();
+            population.resize(SEARCH_POPULATION);
+
+            if (population.front().fitness > best_fitness) {
+                best_fitness = population.front().fitness;
+                stalled = 0;
+                raise_incumbent();
+            }
+            if (next != nullptr && generation % SEARCH_MIGRATION_EVERY == 0)
+                next->receive(population.front());
+        }
+    }
+};
+
+/**
+ * Island-model search over which suggested links to build this turn
+ *
+ * Every island starts from the knapsack draws, last turn's best designs still buildable and
+ * the empty design, plus random ones. Islands run on their own threads until the deadline,
+ * passing their best design around the ring. The SEARCH_ELITE best designs each island
+ * planned go to `result_routes_for_links` for the race, the best ones are kept for the next turn.
+ */
+void search_network_designs(SimModel &model, const t_DudeSupplyChain &supply_chain, const t_actions &links,
+    const std::vector<t_actions> &seeds, std::map<t_actions, t_routes_and_scores> &result_routes_for_links,
+    std::chrono::steady_clock::time_point deadline)
+{
+    if (links.empty())
+        return;
+    std::map<std::tuple<int, int, int>, size_t> index_of;
+    for (size_t i = 0; i < links.size(); i++)
+        index_of[{std::get<0>(links[i])->id, std::get<1>(links[i])->id, std::get<2>(links[i])}] = i;
+
+    std::vector<DesignIsland::t_genome> starts(1, DesignIsland::t_genome(links.size(), 0));
+    auto add_start = [&](const t_design &design) {
+        DesignIsland::t_genome genome(links.size(), 0);
+        for (const auto &key: design) {
+            auto it = index_of.find(key);
+            if (it != index_of.end())
+                genome[it->second] = 1;
+        }
+        starts.push_back(genome);
+    };
+    for (const auto &actions: seeds) {
+        t_design design;
+        for (const auto &[b1, b2, link_type]: actions)
+            design.insert({b1->id, b2->id, link_type});
+        add_start(design);
+    }
+    for (const auto &design: model.design_pool)
+        add_start(design);
+
+    static std::random_device rd;
+    LinkConflicts conflicts(model, links);
+    DesignScreen screen(model, links);
+    std::vector<std::unique_ptr<DesignIsland>> islands;
+    for (int i = 0; i < SEARCH_ISLANDS; i++) {
+        islands.emplace_back(new DesignIsland(model, links, supply_chain, conflicts, screen, rd()));
+        for (size_t s = i; s < starts.size(); s += SEARCH_ISLANDS)
+            islands.back()->seed_with(starts[s]);
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < SEARCH_ISLANDS; i++)
+        threads.emplace_back(&DesignIsland::run, islands[i].get(), deadline, islands[(i + 1) % SEARCH_ISLANDS].get());
+    for (auto &thread: threads)
+        thread.join();
+
+    // Best designs of all islands, each design once
+    std::vector<const DesignIsland::Individual*> ranked;
+    for (const auto &island: islands)
+        for (const auto &individual: island->best_planned())
+            ranked.push_back(&individual);
+    std::sort(ranked.begin(), ranked.end(), [](const auto *a, const auto *b) { return a->fitness > b->fitness; });
+
+    model.design_pool.clear();
+    std::set<DesignIsland::t_genome> kept;
+    for (const auto *individual: ranked) {
+        if (!kept.insert(individual->genome).second)
+            continue;
+        t_actions actions;
+        t_design design;
+        for (size_t i = 0; i < links.size(); i++) {
+            if (!individual->genome[i]) continue;
+            actions.push_back(links[i]);
+            design.insert({std::get<0>(links[i])->id, std::get<1>(links[i])->id, std::get<2>(links[i])});
+        }
+        result_routes_for_links[actions] = individual->routes;
+        if (model.design_pool.size() < SEARCH_POOL_SIZE)
+            model.design_pool.push_back(design);
+    }
+    DesignScreen::Counts counts;
+    for (const auto &island: islands)
+        counts += island->screen_counts();
+    log("Design search: best " + std::to_string(ranked.front()->fitness / 100000) + ", "
+        + std::to_string(counts.considered) + " offspring, " + std::to_string(counts.by_coverage) + " cut on coverage, "
+        + std::to_string(counts.by_hops) + " on hops, " + std::to_string(counts.by_rank) + " ranked out, "
+        + std::to_string(counts.planned) + " planned");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// POD SCHEDULING
+
+typedef std::map<std::pair<int, int>, double> t_hop_counts; // {(from, to): astronauts or seats per month}
+
+/**
+ * Astronauts per month wanting to ride each directed tube hop
+ * Every pad cohort is walked along the distance field of its type, teleporter hops are skipped
+ * The field is the network being planned, which may hold links not built yet
+ */
+t_hop_counts predict_hop_demand(const SimModel &model, const DistanceField &field)
+{
+    t_hop_counts demand;
+    for (const auto &[pad_id, building]: model.buildings) {
+        if (building->building_class != BuildingClass::PAD || pad_id >= MAX_BUILDINGS)
+            continue;
+        for (const auto &[type, count]: dynamic_cast<const LandingPad *>(building)->get_dudes().data) {
+            int at = pad_id;
+            for (int steps = 0; steps < 2 * MAX_ROUTE_DEPTH + 64; steps++) {
+                int next = field.next_hop(type, at);
+                if (next < 0)
+                    break;
+                if (!field.has_teleporter(at, next))
+                    demand[{at, next}] += count;
+                at = next;
+            }
+        }
+    }
+    return demand;
+}
 
-        route.push_back(working_building->id);
-        excluded_id.insert(working_building->id);
-        combinaisons++;
-        // Start every routes from a pad
-        if (working_building->building_class == BuildingClass::PAD)
-        {
-            const LandingPad * working_pad = dynamic_cast<const LandingPad *>(working_building);
-            const Flow& inflow = working_pad->get_dudes();
-
-            // 1. Search amongst the adjency list of the building for a drain
-            for (const auto &co_building: conected_buildings) {
-                if (co_building == nullptr) continue;
-                if (excluded_id.find(co_building->id) != excluded_id.end()) continue;
-                if (working_pad->tp_with(co_building) == TeleporterState::Eingang) { excluded_id.insert(co_building->id); continue;}
-                combinaisons++;
-
-                // 2.Check if it's of direct relevance, pads have type 0 so it will always return false (since no dude has type 0)
-                if (inflow.has_type(co_building->type))
-                {
-                    route.push_back(co_building->id);
-                    excluded_id.insert(co_building->id); // Don't go back to the same building twice
-                    score += 5;
-                    for (const auto &co_co_building: tube_links_per_building[co_building]) {
-                        if (co_co_building == nullptr) continue; // In case I am a retard
-                        if (excluded_id.find(co_co_building->id) != excluded_id.end()) continue;
-                        if (co_building->tp_with(co_co_building) == TeleporterState::Eingang) {excluded_id.insert(co_co_building->id);continue;}
-                        combinaisons++;
-
-                        if (inflow.has_type(co_co_building->type)) {
-                            route.push_back(co_co_building->id);
-                            excluded_id.insert(co_co_building->id);
-                            score += 4;
-                            for (const auto &co_co_co_building: tube_links_per_building[co_co_building]) {
-                                if (co_co_co_building == nullptr) continue;
-                                if (excluded_id.find(co_co_building->id) != excluded_id.end()) continue;
-                                if (co_co_building->tp_with(co_co_co_building) == TeleporterState::Eingang) {excluded_id.insert(co_co_co_building->id);continue;}
-                                combinaisons++;
-
-                                if (inflow.has_type(co_co_co_building->type)) {
-                                    route.push_back(co_co_co_building->id);
-                                    excluded_id.insert(co_co_co_building->id);
-                                    score += 3;
-                                    route.push_back(co_co_building->id);
-                                }
-                            }
-                            route.push_back(co_building->id); // Go back to previous building
-                        }
-                    }
-                    route.push_back(working_building->id); // Go back to the start
-                }
-                //3. If not of direct relevance, check if it is connected to a building that is
-                else
-                {
-                    for (const auto &co_co_building: tube_links_per_building[co_building]) {
-                        if (excluded_id.find(co_co_building->id) != excluded_id.end()) continue;
-                        if (co_building->tp_with(co_co_building) == TeleporterState::Eingang) {excluded_id.insert(co_co_building->id);continue;}
-                        combinaisons++;
-                        if (inflow.has_type(co_co_building->type)) {
-                            route.push_back(co_building->id);
-                            route.push_back(co_co_building->id);
-                            excluded_id.insert(co_building->id);
-                            excluded_id.insert(co_co_building->id);
-                            score += 3;
-                            for (const auto &co_co_co_building: tube_links_per_building[co_co_building]) {
-                                if (co_co_co_building == nullptr) continue;
-                                if (excluded_id.find(co_co_building->id) != excluded_id.end()) continue;
-                                combinaisons++;
-                                if (inflow.has_type(co_co_co_building->type)) {
-                                    route.push_back(co_co_co_building->id);
-                                    excluded_id.insert(co_co_co_building->id);
-                                    score += 4;
-                                    route.push_back(co_co_building->id);
-                                }
-                            }
-                            route.push_back(co_building->id);
-                            route.push_back(working_building->id);
-                        }
-                    }
-                }
+/**
+ * Seats per month a pod offers on each directed hop of its route
+ * A closed route of L hops is run DAYS_PER_MONTH / L times a month
+ */
+void add_route_seats(t_hop_counts &seats, const t_route &route, double pods = 1.0)
+{
+    if (route.size() < 2)
+        return;
+    double cycles = (double)DAYS_PER_MONTH / (route.size() - 1);
+    for (size_t i = 0; i + 1 < route.size(); i++)
+        seats[{route[i], route[i + 1]}] += pods * POD_CAPACITY * cycles;
+}
+
+// Pods crossing each tube per day, both directions share the capacity
+void add_route_load(t_hop_counts &load, const t_route &route, double pods = 1.0)
+{
+    if (route.size() < 2)
+        return;
+    for (size_t i = 0; i + 1 < route.size(); i++)
+        load[tube_key(route[i], route[i + 1])] += pods / (route.size() - 1);
+}
+
+struct CongestionReport {
+    std::map<std::pair<int, int>, std::vector<int>> occupancy;  // {tube: pods through it, per day}
+    std::map<std::pair<int, int>, int>              tube_stalls;// {tube: pod-days spent waiting for it}
+    std::map<int, int>                              pod_stalls; // {pod id: days waiting}
+    int                                             moves = 0;  // Pod moves over the month
+};
+
+/**
+ * Day by day replay of the fleet over one month, the way the referee allocates tubes:
+ * pods are served by increasing id and a tube lets at most `capacity` pods through per day,
+ * the others wait in place. Pods start at their first stop, closed routes loop, open ones bounce.
+ */
+CongestionReport simulate_congestion(std::vector<FleetPod> fleet, const std::map<std::pair<int, int>, int> &capacity)
+{
+    std::sort(fleet.begin(), fleet.end(), [](const FleetPod &a, const FleetPod &b) { return a.id < b.id; });
+    std::vector<PodCursor> cursors(fleet.size());
+    CongestionReport report;
+
+    for (int day = 0; day < DAYS_PER_MONTH; day++) {
+        std::map<std::pair<int, int>, int> used;
+        for (size_t p = 0; p < fleet.size(); p++) {
+            const t_route &route = *fleet[p].route;
+            if (route.size() < 2)
+                continue;
+            PodCursor next = cursors[p].advanced(route);
+            auto key = tube_key(route[cursors[p].index], route[next.index]);
+            auto cap = capacity.find(key);
+            int limit = cap == capacity.end() ? 0 : cap->second;
+            std::vector<int> &occupancy = report.occupancy[key];
+            occupancy.resize(DAYS_PER_MONTH, 0);
+            if (used[key] >= limit) {
+                report.tube_stalls[key]++;
+                report.pod_stalls[fleet[p].id]++;
+                continue;
             }
+            used[key]++;
+            occupancy[day]++;
+            report.moves++;
+            cursors[p] = next;
         }
-        if (route.size() < 2) continue; // No route found
-        else {
-            selected_routes.push_back({score, route});
+    }
+    return report;
+}
+
+/**
+ * Tubes worth upgrading: the ones where the fleet stalls, if one more slot per day
+ * lets at least upgrade_min_gained_moves more pod moves through in a month
+ * Returns (tube, extra moves) by decreasing gain
+ */
+std::vector<std::pair<Link*, int>> plan_upgrades(const SimModel &model)
+{
+    std::vector<FleetPod> fleet = current_fleet(model);
+    std::map<std::pair<int, int>, int> capacity = tube_capacities(model);
+    CongestionReport base = simulate_congestion(fleet, capacity);
+
+    std::vector<std::pair<Link*, int>> upgrades;
+    for (const auto &[id, tube]: model.tubes) {
+        auto key = tube_key(tube->b1->id, tube->b2->id);
+        if (tube->capacity >= MAX_TUBE_CAPACITY || base.tube_stalls[key] == 0)
+            continue;
+        capacity[key]++;
+        int gained = simulate_congestion(fleet, capacity).moves - base.moves;
+        capacity[key]--;
+        if (gained >= params().upgrade_min_gained_moves)
+            upgrades.push_back({tube, gained});
+    }
+    std::sort(upgrades.begin(), upgrades.end(), [](const auto &a, const auto &b) { return a.second > b.second; });
+    return upgrades;
+}
+
+struct PodPlan {
+    t_route route;
+    int     pods;
+    double  demand; // Unserved astronauts per month on the busiest hop of the route
+};
+
+/**
+ * How many pods each route needs, busiest routes first so they get the smallest ids
+ * (smaller ids win tube slots and boarding). Demand already covered by existing pods is not
+ * counted again, and no tube is loaded past the pods per day its capacity lets through.
+ * Every extra pod is then replayed against the fleet by simulate_congestion and kept only
+ * if it adds at least half a month of moves, stalls it causes to lower priority pods included.
+ */
+std::vector<PodPlan> schedule_pods(const SimModel &model, const t_routes_and_scores &routes,
+    const DistanceField &field, const std::map<std::pair<int, int>, int> &capacity)
+{
+    t_hop_counts demand = predict_hop_demand(model, field);
+    t_hop_counts seats, load;
+    for (const auto &[id, pod]: model.pods) {
+        add_route_seats(seats, pod->route);
+        add_route_load(load, pod->route);
+    }
+
+    // Unserved demand on the busiest hop of each route, against the existing fleet only
+    auto unserved_on = [&](const t_route &route, double &wanted) {
+        t_hop_counts one_pod;
+        add_route_seats(one_pod, route);
+        double busiest = 0;
+        wanted = 0;
+        for (const auto &[hop, pod_seats]: one_pod) {
+            auto d = demand.find(hop);
+            double unserved = (d == demand.end() ? 0 : d->second) - seats[hop];
+            if (unserved <= 0) continue;
+            busiest = std::max(busiest, unserved);
+            wanted = std::max(wanted, std::ceil(unserved / pod_seats));
         }
+        return busiest;
+    };
+
+    std::vector<PodPlan> candidates;
+    for (const auto &[score, route]: routes) {
+        if (score == 0 || route.size() < 3)
+            continue;
+        double wanted;
+        double busiest = unserved_on(route, wanted);
+        if (busiest > 0)
+            candidates.push_back({route, 0, busiest});
     }
-    return selected_routes;
+    std::stable_sort(candidates.begin(), candidates.end(), [](const PodPlan &a, const PodPlan &b) { return a.demand > b.demand; });
+
+    std::vector<PodPlan> plans;
+    std::vector<FleetPod> fleet = current_fleet(model);
+    int moves = simulate_congestion(fleet, capacity).moves;
+    int next_id = Pod::next_id();
+
+    for (auto &plan: candidates) {
+        double wanted;
+        if (unserved_on(plan.route, wanted) <= 0)
+            continue;
+        plan.pods = min(MAX_PODS_PER_ROUTE, (int)wanted);
+
+        // Pods allowed: the tube with the least spare capacity decides
+        const t_route &route = plan.route;
+        for (size_t i = 0; i + 1 < route.size() && plan.pods > 0; i++) {
+            auto key = tube_key(route[i], route[i + 1]);
+            auto cap = capacity.find(key);
+            if (cap == capacity.end()) { plan.pods = 0; break; } // Not a tube (yet)
+            double per_pod = 0;
+            for (size_t j = 0; j + 1 < route.size(); j++)
+                if (tube_key(route[j], route[j + 1]) == key) per_pod += 1.0 / (route.size() - 1);
+            plan.pods = min(plan.pods, max(0, (int)std::floor((cap->second - load[key]) / per_pod + EPSILON)));
+        }
+
+        // Replay with the new pods, drop the ones that mostly wait
+        for (; plan.pods > 0; plan.pods--) {
+            std::vector<FleetPod> trial = fleet;
+            for (int k = 0; k < plan.pods; k++)
+                trial.push_back({next_id + k, &plan.route});
+            int trial_moves = simulate_congestion(trial, capacity).moves;
+            if (trial_moves - moves >= plan.pods * DAYS_PER_MONTH / 2) {
+                fleet = trial;
+                moves = trial_moves;
+                break;
+            }
+        }
+        if (plan.pods <= 0)
+            continue;
+        next_id += plan.pods;
+        add_route_seats(seats, route, plan.pods);
+        add_route_load(load, route, plan.pods);
+        plans.push_back(plan);
+    }
+    return plans;
+}
+
+/** Pods for the network as built */
+std::vector<PodPlan> schedule_pods(const SimModel &model, const t_routes_and_scores &routes)
+{
+    return schedule_pods(model, routes, network_field(model), tube_capacities(model));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// RACING
+
+#define RACE_HORIZONS {5, 10, DAYS_PER_MONTH} // Days simulated at each round of the race
+#define RACE_TIME_SHARE 2 // The race may use 1/RACE_TIME_SHARE of the time kept for the route search
+
+struct RaceEntry {
+    const t_actions*            actions;
+    const t_routes_and_scores*  routes;
+    int                         cost = 0;   // Links, then the pods once scheduled
+    std::vector<PodPlan>        pods{};     // What apply_best_routes would buy, scheduled on the first forecast
+    bool                        scheduled = false;
+    long long                   bound = 0;  // OptimisticPoints on coverage then hop counts, every month left
+    long long                   gain = 0;   // Points forecast by the last round it ran, over the months left
+    int                         days = 0;   // Horizon of that forecast, 0 if never forecast
+};
+
+/**
+ * Forecasts of the race entrants, all on one field and one capacity map
+ * An entrant's links are loaded as a trial and taken back after, its new tubes opened to
+ * one pod a day. The fleet and the forecast are scratch buffers: once they have grown,
+ * forecasting an entrant does not allocate (scheduling its pods, done once, does).
+ */
+class RaceForecaster {
+    const SimModel&                     model;
+    DistanceField                       field;
+    std::map<std::pair<int, int>, int>  capacity;   // Every entrant's tubes are in, at 0 until loaded
+    std::vector<FleetPod>               fleet;
+    std::vector<FleetPod>               trial_fleet; // Scratch, assigned from fleet
+    std::vector<int*>                   opened;     // Capacities set to 1 by load(), idem
+    ArrivalScratch                      arrivals;   // idem
+    ArrivalForecast                     result;     // idem
+
+public:
+    RaceForecaster(const SimModel &model, const std::map<t_actions, t_routes_and_scores> &candidates)
+        : model(model), field(network_field(model)), capacity(tube_capacities(model)), fleet(current_fleet(model))
+    {
+        for (const auto &[actions, routes]: candidates)
+            for (const auto &[b1, b2, link_type]: actions)
+                if (link_type == T_TUBE)
+                    capacity.try_emplace(tube_key(b1->id, b2->id), 0);
+    }
+
+    // Load an entrant's links in the field until unload()
+    void load(const t_actions &actions) {
+        field.begin_trial();
+        for (const auto &[b1, b2, link_type]: actions) {
+            if (b1->id >= MAX_BUILDINGS || b2->id >= MAX_BUILDINGS) continue;
+            if (link_type == T_TELE) {
+                field.add_teleporter(b1->id, b2->id);
+                continue;
+            }
+            field.add_tube(b1->id, b2->id);
+            int &tube_capacity = capacity[tube_key(b1->id, b2->id)];
+            if (tube_capacity == 0) {
+                tube_capacity = 1;
+                opened.push_back(&tube_capacity);
+            }
+        }
+    }
+
+    void unload() {
+        field.end_trial();
+        for (int *tube_capacity: opened)
+            *tube_capacity = 0;
+        opened.clear();
+    }
+
+    // The distance field of the loaded entrant
+    const DistanceField &loaded_field() const { return field; }
+
+    // The pods apply_best_routes would buy for the loaded entrant, as many as the resources left pay for
+    void schedule(RaceEntry &entry) {
+        entry.scheduled = true;
+        entry.pods = schedule_pods(model, *entry.routes, field, capacity);
+        for (auto &plan: entry.pods) {
+            plan.pods = max(0, min(plan.pods, (model.resources - entry.cost) / POD_PRICE));
+            entry.cost += plan.pods * POD_PRICE;
+        }
+    }
+
+    // Points of one month of the loaded entrant with its pods, cut to `days`
+    long long forecast(const RaceEntry &entry, int days) {
+        trial_fleet = fleet;
+        int id = Pod::next_id();
+        for (const auto &plan: entry.pods)
+            for (int i = 0; i < plan.pods; i++)
+                trial_fleet.push_back({id++, &plan.route});
+        predict_arrivals(model, field, trial_fleet, capacity, arrivals, result, days);
+        return result.speed_points + result.balance.score();
+    }
+};
+
+/**
+ * Pick the action set to build by successive halving
+ *
+ * Entrants first get the bounds the design search screens with (OptimisticPoints): on
+ * coverage, then on the hop counts of their distance field for those the first leaves in.
+ * Entrants whose bound cannot beat the incumbent (the best route score, forecast over the
+ * full month) are dropped unsimulated.
+ * The others are forecast over 5 days, the better half over 10, the better half of those
+ * over the full month. Each is forecast with the pods schedule_pods would buy on its network,
+ * as many as the resources left after the links pay for, and their price is charged. Every set forecast over the full month joins
+ * a Pareto frontier of (price, points over the months left), and the winner is the frontier
+ * point with the best gain once the price is charged at the compounded value of resources.
+ * Returns the winner, or nullptr when there is nothing to race.
+ */
+const t_actions *race_action_sets(SimModel &model, const std::map<t_actions, t_routes_and_scores> &candidates)
+{
+    if (candidates.empty())
+        return nullptr;
+    auto deadline = std::chrono::steady_clock::now() + (model.turn_deadline - std::chrono::steady_clock::now()) / RACE_TIME_SHARE;
+    int months_left = max(1, MAP_MONTHS_LEFT(model.round));
+    double price = resource_value(model.round);
+    RaceForecaster forecaster(model, candidates);
+    ModelOverlay overlay(model);
+    OptimisticPoints optimistic(model);
+
+    std::vector<RaceEntry> entries;
+    size_t incumbent_index = 0;
+    long long best_route_score = -1;
+    for (const auto &[actions, routes]: candidates) {
+        RaceEntry entry{&actions, &routes};
+        size_t mark = overlay.mark();
+        for (const auto &[b1, b2, link_type]: actions) {
+            entry.cost += action_cost(b1, b2, link_type);
+            overlay.apply(b1, b2, link_type);
+        }
+        entry.bound = optimistic(overlay, nullptr) * months_left;
+        overlay.rollback(mark);
+        entries.push_back(entry);
+
+        long long route_score = 0;
+        for (const auto &[score, route]: routes)
+            route_score += score;
+        if (route_score > best_route_score) {
+            best_route_score = route_score;
+            incumbent_index = entries.size() - 1;
+        }
+    }
+
+    auto forecast = [&](RaceEntry &entry, int days) {
+        forecaster.load(*entry.actions);
+        if (!entry.scheduled)
+            forecaster.schedule(entry);
+        entry.gain = forecaster.forecast(entry, days) * months_left;
+        entry.days = days;
+        forecaster.unload();
+    };
+    auto value = [&](const RaceEntry &entry, long long gain) { return gain - price * entry.cost; };
+
+    // The incumbent runs the full month first so the bounds have something to beat
+    ParetoFrontier<const RaceEntry*> frontier;
+    forecast(entries[incumbent_index], DAYS_PER_MONTH);
+    frontier.insert(entries[incumbent_index].cost, entries[incumbent_index].gain, &entries[incumbent_index]);
+    double incumbent = value(entries[incumbent_index], entries[incumbent_index].gain);
+    std::vector<RaceEntry*> field_of;
+    size_t by_coverage = 0, by_hops = 0;
+    for (auto &entry: entries) {
+        if (&entry == &entries[incumbent_index])
+            continue;
+        if (value(entry, entry.bound) <= incumbent) {
+            by_coverage++;
+            continue;
+        }
+        size_t mark = overlay.mark();
+        for (const auto &[b1, b2, link_type]: *entry.actions)
+            overlay.apply(b1, b2, link_type);
+        forecaster.load(*entry.actions);
+        entry.bound = optimistic(overlay, &forecaster.loaded_field()) * months_left;
+        forecaster.unload();
+        overlay.rollback(mark);
+        if (value(entry, entry.bound) <= incumbent)
+            by_hops++;
+        else
+            field_of.push_back(&entry);
+    }
+    size_t entrants = entries.size(), simulated = 1;
+
+    for (int days: RACE_HORIZONS) {
+        if (field_of.empty() || std::chrono::steady_clock::now() >= deadline)
+            break;
+        for (RaceEntry *entry: field_of) {
+            if (std::chrono::steady_clock::now() >= deadline)
+                break;
+            forecast(*entry, days);
+            simulated++;
+        }
+        std::sort(field_of.begin(), field_of.end(), [&](const RaceEntry *a, const RaceEntry *b) {
+            return value(*a, a->gain) > value(*b, b->gain);
+        });
+        if (days == DAYS_PER_MONTH) {
+            // The deadline may have cut this round short, shorter forecasts are not comparable
+            for (const RaceEntry *entry: field_of)
+                if (entry->days == DAYS_PER_MONTH)
+                    frontier.insert(entry->cost, entry->gain, entry);
+            break;
+        }
+        field_of.resize((field_of.size() + 1) / 2);
+    }
+    const auto *winner = frontier.select(price);
+    log("Race: " + std::to_string(entrants) + " entrants, " + std::to_string(by_coverage) + " cut on coverage, "
+        + std::to_string(by_hops) + " on hops, " + std::to_string(simulated) + " forecasts, "
+        + std::to_string(frontier.size()) + " on the frontier, winner costs " + std::to_string(winner->cost)
+        + " for " + std::to_string(winner->gain));
+    return winner->item->actions;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// CANDIDATE STREAM
+
+/**
+ * One draw of sample_links, applied to the overlay
+ * Candidates that conflict with the ones before them in the set are dropped
+ */
+t_actions apply_draw(SimModel &model, ModelOverlay &overlay, const t_actions &suggested_links, size_t width,
+    LinkValuation &valuation)
+{
+    t_actions sampled_links = sample_links(suggested_links, width, model.resources, model, valuation);
+    t_actions actions_for_these_links;
+    for (const auto &action : sampled_links) {
+        const auto &[b1, b2, link_type] = action;
+        if (overlay.apply(b1, b2, link_type) == SUCCESS)
+            actions_for_these_links.push_back(action);
+    }
+    return actions_for_these_links;
+}
+
+#if JI_COROUTINES
+
+/**
+ * Lazy sequence of values from a coroutine, pulled one at a time with next()
+ */
+template <typename T>
+class Generator {
+public:
+    struct promise_type {
+        T value;
+
+        Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(T produced) { value = std::move(produced); return {}; }
+        void return_void() {}
+        void unhandled_exception() { throw; }
+    };
+
+    explicit Generator(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    Generator(Generator &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Generator(const Generator &) = delete;
+    ~Generator() { if (handle) handle.destroy(); }
+
+    // Runs the producer up to its next value, false once it is done
+    bool next(T &out) {
+        if (!handle || handle.done())
+            return false;
+        handle.resume();
+        if (handle.done())
+            return false;
+        out = std::move(handle.promise().value);
+        return true;
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+typedef Generator<t_actions> CandidateStream;
+
+/**
+ * `count` draws, each one applied to the overlay while the consumer plans its routes,
+ * and rolled back when the consumer asks for the next one
+ */
+CandidateStream candidate_sets(SimModel &model, ModelOverlay &overlay, const t_actions &suggested_links, size_t count)
+{
+    LinkValuation valuation(model);
+    valuation.expect_tubes(suggested_links);
+    for (size_t i = 0; i < count; i++) {
+        log("Iter: " + std::to_string(i));
+        size_t mark = overlay.mark();
+        co_yield apply_draw(model, overlay, suggested_links, count, valuation);
+        overlay.rollback(mark);
+    }
+}
+
+#else
+
+// Same stream without coroutines: next() rolls the last draw back before applying a new one
+class CandidateStream {
+public:
+    CandidateStream(SimModel &model, ModelOverlay &overlay, const t_actions &suggested_links, size_t count)
+        : model(model), overlay(overlay), suggested_links(suggested_links), count(count), valuation(model) {
+        valuation.expect_tubes(suggested_links);
+    }
+
+    bool next(t_actions &out) {
+        if (drawn > 0)
+            overlay.rollback(mark);
+        if (drawn >= count)
+            return false;
+        log("Iter: " + std::to_string(drawn));
+        mark = overlay.mark();
+        out = apply_draw(model, overlay, suggested_links, count, valuation);
+        drawn++;
+        return true;
+    }
+
+private:
+    SimModel            &model;
+    ModelOverlay        &overlay;
+    const t_actions     &suggested_links;
+    size_t              count, drawn = 0, mark = 0;
+    LinkValuation       valuation;
+};
+
+CandidateStream candidate_sets(SimModel &model, ModelOverlay &overlay, const t_actions &suggested_links, size_t count)
+{
+    return CandidateStream(model, overlay, suggested_links, count);
 }
 
+#endif
+
+/**
+ * The coordinator: sample_links splits the budget between links, cross-city ones included,
+ * then every city of the resulting network plans its routes on its own
+ */
 std::map<t_actions, t_routes_and_scores> check_routes(SimModel &model, const t_DudeSupplyChain &supply_chain, t_actions &suggested_links)
 {
     // A list of all [routes + score]
     std::map<t_actions, t_routes_and_scores>    result_routes_for_links;
+    ModelOverlay                                overlay(model);
 
     if (suggested_links.size() == 0) {
         log("No suggested links");
-        result_routes_for_links[suggested_links] = make_paths(model.get_all_links(), supply_chain, model.resources, model);
+        result_routes_for_links[suggested_links] = make_paths_by_city(overlay, supply_chain, model.resources, model);
         return result_routes_for_links;
     } else {
         log("Suggested links: " + std::to_string(suggested_links.size()));
@@ -1269,31 +4712,259 @@ std::map<t_actions, t_routes_and_scores> check_routes(SimModel &model, const t_D
     ////////////////////////////////////////////////////////////////////
     // TODO: Finds a better way to combine ALL possible links, and not just pairs
 
+    auto deadline = std::min(std::chrono::steady_clock::now() + std::chrono::milliseconds(SEARCH_BUDGET_MS),
+        model.turn_deadline - std::chrono::milliseconds(ROUTE_SEARCH_RESERVE_MS));
     size_t n = suggested_links.size();
-    size_t loop_iter = max(8, size_t(log(n)));
+    size_t loop_iter = max((size_t)params().min_draws, size_t(log(n)));
+    // Once the bandit knows which families pay, half the draws find the same sets
+    if (model.bandit.history() >= BANDIT_WARMUP_PULLS)
+        loop_iter /= 2;
+    std::vector<t_actions> draws;
+    std::vector<long long> draw_scores;
     log("Loop iter: " + std::to_string(loop_iter));
-    for (size_t i = 0; i < loop_iter; i++)
+    // Each set is planned while the stream holds it in the overlay, the next one is only drawn after
+    CandidateStream stream = candidate_sets(model, overlay, suggested_links, loop_iter);
+    for (t_actions actions_for_these_links; stream.next(actions_for_these_links);)
     {
-        log("Iter: " + std::to_string(i));
-        t_actions actions_for_these_links = sample_links(suggested_links, loop_iter, model.resources);
+        result_routes_for_links[actions_for_these_links] = make_paths_by_city(overlay, supply_chain, model.resources, model);
+        draws.push_back(actions_for_these_links);
+        long long score = 0;
+        for (const auto &[route_score, route]: result_routes_for_links[actions_for_these_links])
+            score += route_score;
+        draw_scores.push_back(score);
+    }
 
-        std::vector<Link*>  theory_links;
-        for (const auto &[b1, b2, link_type] : actions_for_these_links) {
-            if (link_type == T_TUBE) {
-                theory_links.push_back(new Tube(b1, b2));
-            } else {
-                theory_links.push_back(new Teleporter(b1, b2));
+    // Every link of a draw is credited with how close the draw came to the best one
+    long long worst = *std::min_element(draw_scores.begin(), draw_scores.end());
+    long long best = *std::max_element(draw_scores.begin(), draw_scores.end());
+    for (size_t i = 0; i < draws.size() && best > worst; i++)
+        for (const auto &[b1, b2, link_type]: draws[i])
+            model.bandit.reward(link_arm(b1, b2, link_type), (double)(draw_scores[i] - worst) / (best - worst));
+    log(model.bandit.to_string());
+
+    // The draws are where the search starts from
+    search_network_designs(model, supply_chain, suggested_links, draws, result_routes_for_links, deadline);
+
+    // Only the winner of the race is handed to apply_best_routes
+    const t_actions *winner = race_action_sets(model, result_routes_for_links);
+    if (winner != nullptr) {
+        auto kept = result_routes_for_links.extract(*winner);
+        result_routes_for_links.clear();
+        result_routes_for_links.insert(std::move(kept));
+    }
+    return result_routes_for_links;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ROUTE LOCAL SEARCH
+
+#define ROUTE_SEARCH_EVALS 60   // Forecasts spent improving one route
+
+// Lexicographic: astronauts delivered, then their points, then the shorter cycle
+struct RouteFitness {
+    int     arrived = -1;
+    int     points = 0;
+    size_t  length = 0;
+
+    bool better_than(const RouteFitness &other) const {
+        if (arrived != other.arrived) return arrived > other.arrived;
+        if (points != other.points) return points > other.points;
+        return length < other.length;
+    }
+};
+
+/**
+ * Hill climbing on pod routes, every move scored by predict_arrivals
+ *
+ * Routes stay closed tours from their first stop: interior stops can be pruned (a segment
+ * is cut when its neighbours share a tube, which also removes A B A detours), reversed
+ * (2-opt) or moved elsewhere (or-opt, segments of up to 3 stops). A move is kept only
+ * if every hop is an existing tube and the forecast improves. Routes sharing a stop are
+ * merged into one tour when the second pod would not pay for itself before the game ends.
+ */
+class RouteOptimizer {
+    const SimModel&                     model;
+    DistanceField                       field;
+    std::map<std::pair<int, int>, int>  capacity;
+    std::vector<FleetPod>               fleet;  // The pods that are not being optimised
+    std::vector<FleetPod>               trial;  // Scratch of score(), assigned from fleet
+    ArrivalScratch                      arrivals; // idem
+    ArrivalForecast                     forecast; // idem
+    int                                 evals = 0;
+    std::chrono::steady_clock::time_point deadline;
+
+    bool legal(const t_route &route) const {
+        if (route.size() < 3 || route.front() != route.back())
+            return false;
+        for (size_t i = 0; i + 1 < route.size(); i++)
+            if (route[i] == route[i + 1] || !model.tubes_by_ends.count(tube_key(route[i], route[i + 1])))
+                return false;
+        return true;
+    }
+
+    // Collapse the repeated stops a cut leaves behind
+    static t_route tidy(t_route route) {
+        route.erase(std::unique(route.begin(), route.end()), route.end());
+        return route;
+    }
+
+public:
+    RouteOptimizer(const SimModel &model, std::chrono::steady_clock::time_point deadline)
+    : model(model), field(network_field(model)), capacity(tube_capacities(model)), fleet(current_fleet(model)), deadline(deadline) {}
+
+    bool out_of_time() const { return std::chrono::steady_clock::now() >= deadline; }
+
+    // Leave a pod out of the fleet the routes are scored against
+    void exclude_pod(int pod_id) {
+        fleet.erase(std::remove_if(fleet.begin(), fleet.end(), [&](const FleetPod &p) { return p.id == pod_id; }), fleet.end());
+    }
+
+    void include_pod(int pod_id, const t_route *route) {
+        fleet.push_back({pod_id, route});
+    }
+
+    RouteFitness score(const std::vector<const t_route*> &routes) {
+        evals++;
+        trial = fleet;
+        int id = Pod::next_id();
+        for (const t_route *route: routes)
+            trial.push_back({id++, route});
+        predict_arrivals(model, field, trial, capacity, arrivals, forecast);
+        RouteFitness fitness;
+        fitness.arrived = forecast.arrived;
+        fitness.points = forecast.speed_points + forecast.balance.score();
+        for (const t_route *route: routes)
+            fitness.length += route->size();
+        return fitness;
+    }
+
+    RouteFitness score(const t_route &route) {
+        return score(std::vector<const t_route*>{&route});
+    }
+
+    t_route improve(t_route route) {
+        if (!legal(route) || out_of_time())
+            return route;
+        RouteFitness best = score(route);
+        int budget = evals + ROUTE_SEARCH_EVALS;
+
+        auto try_route = [&](const t_route &candidate) {
+            if (evals >= budget || candidate == route || !legal(candidate) || out_of_time())
+                return false;
+            RouteFitness fitness = score(candidate);
+            if (!fitness.better_than(best))
+                return false;
+            best = fitness;
+            route = candidate;
+            return true;
+        };
+
+        for (bool improved = true; improved && evals < budget;) {
+            improved = false;
+            size_t last = route.size() - 1;
+            // Stop pruning, longest cuts first
+            for (size_t len = 3; len >= 1 && !improved; len--)
+                for (size_t i = 1; i + len <= last && !improved; i++) {
+                    t_route cut(route.begin(), route.begin() + i);
+                    cut.insert(cut.end(), route.begin() + i + len, route.end());
+                    improved = try_route(tidy(cut));
+                }
+            // 2-opt
+            for (size_t i = 1; i + 1 < last && !improved; i++)
+                for (size_t j = i + 1; j < last && !improved; j++) {
+                    t_route reversed = route;
+                    std::reverse(reversed.begin() + i, reversed.begin() + j + 1);
+                    improved = try_route(reversed);
+                }
+            // Or-opt
+            for (size_t len = 1; len <= 3 && !improved; len++)
+                for (size_t i = 1; i + len <= last && !improved; i++)
+                    for (size_t to = 1; to <= last - len && !improved; to++) {
+                        if (to == i) continue;
+                        t_route moved = route;
+                        t_route segment(moved.begin() + i, moved.begin() + i + len);
+                        moved.erase(moved.begin() + i, moved.begin() + i + len);
+                        moved.insert(moved.begin() + to, segment.begin(), segment.end());
+                        improved = try_route(tidy(moved));
+                    }
+        }
+        return route;
+    }
+
+    /**
+     * Splice `b` into `a` at a shared stop when one pod on the merged tour loses less
+     * than a second pod would earn back over the months left
+     */
+    bool try_merge(t_route &a, const t_route &b, int months_left) {
+        for (size_t i = 0; i + 1 < a.size(); i++) {
+            auto at = std::find(b.begin(), b.end() - 1, a[i]);
+            if (at == b.end() - 1)
+                continue;
+            // b rotated to start and end at the shared stop
+            t_route loop(at, b.end() - 1);
+            loop.insert(loop.end(), b.begin(), at + 1);
+            t_route merged(a.begin(), a.begin() + i);
+            merged.insert(merged.end(), loop.begin(), loop.end());
+            merged.insert(merged.end(), a.begin() + i + 1, a.end());
+            merged = tidy(merged);
+            if (!legal(merged))
+                continue;
+            if (out_of_time())
+                return false;
+            RouteFitness apart = score(std::vector<const t_route*>{&a, &b});
+            RouteFitness together = score(merged);
+            if ((apart.points - together.points) * months_left < POD_PRICE) {
+                a = merged;
+                return true;
             }
+            return false;
         }
-        std::vector<Link*> sub_space = model.get_all_links();
-        for (const auto &link: theory_links) {
-            sub_space.push_back(link);
+        return false;
+    }
+};
+
+// Improve the planned routes, then merge the ones a single pod can serve
+void optimize_routes(const SimModel &model, t_routes_and_scores &routes)
+{
+    RouteOptimizer optimizer(model, model.turn_deadline);
+    for (auto &[score, route]: routes)
+        route = optimizer.improve(route);
+
+    int months_left = max(1, MAP_MONTHS_LEFT(model.round));
+    for (size_t i = 0; i < routes.size(); i++) {
+        if (routes[i].first == 0) continue;
+        for (size_t j = i + 1; j < routes.size(); j++) {
+            if (routes[j].first == 0 || !optimizer.try_merge(routes[i].second, routes[j].second, months_left))
+                continue;
+            routes[i].first += routes[j].first;
+            routes.erase(routes.begin() + j--);
         }
-        result_routes_for_links[actions_for_these_links] = make_paths(sub_space, supply_chain, model.resources, model);
-        for (const auto &link : theory_links) delete link;
     }
+}
 
-    return result_routes_for_links;
+/**
+ * Pods already flying whose route improves enough to pay for the rebuild (destroy, refund, new pod)
+ * Returns (pod id, new route)
+ */
+std::vector<std::pair<int, t_route>> reroute_pods(const SimModel &model)
+{
+    std::vector<std::pair<int, t_route>> reroutes;
+    int months_left = max(1, MAP_MONTHS_LEFT(model.round));
+    // Half of what is left, the new routes get the other half
+    auto now = std::chrono::steady_clock::now();
+    RouteOptimizer optimizer(model, now + (model.turn_deadline - now) / 2);
+    for (const auto &[id, pod]: model.pods) {
+        if (optimizer.out_of_time())
+            break;
+        optimizer.exclude_pod(id);
+        RouteFitness before = optimizer.score(pod->route);
+        t_route better = optimizer.improve(pod->route);
+        RouteFitness after = optimizer.score(better);
+        optimizer.include_pod(id, &pod->route);
+        if (better != pod->route && (after.points - before.points) * months_left > POD_PRICE - POD_REFUND)
+            reroutes.push_back({id, better});
+    }
+    return reroutes;
 }
 
 void apply_best_routes(SimModel &model, std::map<t_actions, t_routes_and_scores> &result_routes_for_links)
@@ -1318,6 +4989,9 @@ void apply_best_routes(SimModel &model, std::map<t_actions, t_routes_and_scores>
         return;
     } else {
         for (const auto &[b1, b2, link_type] : *best_actions) {
+            int cost = action_cost(b1, b2, link_type);
+            if (cost > model.resources) continue;
+            model.bill(cost, "link");
             if (link_type == T_TUBE) {
                 print_action_tube(b1->id, b2->id);
                 connect_buildings(model, b1, b2, T_TUBE);
@@ -1327,14 +5001,37 @@ void apply_best_routes(SimModel &model, std::map<t_actions, t_routes_and_scores>
             }
         }
 
-    t_routes_and_scores actions_score = result_routes_for_links[*best_actions];
-    for (const auto &pair : actions_score) {
-        if (pair.first == 0) continue;
-        if (pair.second.size() < 3) continue;
-
-        Pod *pod = new Pod(pair.second);
+    // Existing pods first, they keep their priority if they stay
+    for (const auto &[id, route] : reroute_pods(model)) {
+        if (model.resources + POD_REFUND < POD_PRICE) break;
+        print_action_destroy(id);
+        model.bill(POD_PRICE - POD_REFUND, "reroute");
+        delete model.pods[id];
+        model.pods.erase(id);
+        Pod *pod = new Pod(route);
         model.pods[pod->id] = pod;
-        print_action_pod(pod->id, pair.second);
+        print_action_pod(pod->id, route);
+    }
+
+    // Links are in the model now, the distance fields show where astronauts will head
+    t_routes_and_scores &best_routes = result_routes_for_links[*best_actions];
+    optimize_routes(model, best_routes);
+    for (const auto &plan : schedule_pods(model, best_routes)) {
+        for (int i = 0; i < plan.pods && model.resources >= POD_PRICE; i++) {
+            model.bill(POD_PRICE, "pod");
+            Pod *pod = new Pod(plan.route);
+            model.pods[pod->id] = pod;
+            print_action_pod(pod->id, plan.route);
+        }
+    }
+
+    // Then widen the tubes the fleet queues on
+    for (const auto &[tube, gained] : plan_upgrades(model)) {
+        int cost = upgrade_cost(tube);
+        if (cost > model.resources) continue;
+        model.bill(cost, "upgrade");
+        tube->upgrade();
+        print_action_upgrade_tube(tube->b1->id, tube->b2->id);
     }
     }
 }
@@ -1381,24 +5078,140 @@ void semi_optimal_algorithm(SimModel& model)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// TELEMETRY
+
+/**
+ * What the model expects the referee to send back next turn
+ */
+struct TurnExpectation {
+    int                                 round = -1;
+    int                                 resources_left = 0; // Once this turn's actions are paid
+    std::map<std::pair<int, int>, int>  capacities;         // {(b1, b2): capacity}, 0 for teleporters
+    std::map<int, t_route>              pods;               // {id: stops}
+    int                                 points = 0;         // Forecast of the month about to be played
+};
+
+/**
+ * Checks the model against the next turn's input
+ *
+ * After each turn, expect() records what the actions should lead to. Once the next input
+ * is parsed, check() diffs it against the resources, links and pods the referee echoes.
+ * Income is not part of the input: the first turn measures it, later turns check it did
+ * not change. The referee never echoes points, the forecasts are logged for comparison
+ * with its own report. A summary goes to stderr (and TELEMETRY_FILE) at the end of the game.
+ */
+class Telemetry {
+public:
+    void expect(const SimModel &model) {
+        expected = TurnExpectation();
+        expected.round = model.round;
+        expected.resources_left = model.resources;
+        for (const auto &[id, tube]: model.tubes)
+            expected.capacities[tube_key(tube->b1->id, tube->b2->id)] = tube->capacity;
+        for (const auto &[id, tele]: model.teleporters)
+            expected.capacities[{tele->b1->id, tele->b2->id}] = 0;
+        for (const auto &[id, pod]: model.pods)
+            expected.pods[id] = pod->route;
+        ArrivalForecast forecast = predict_arrivals(model);
+        expected.points = forecast.speed_points + forecast.balance.score();
+        predicted_points += expected.points;
+    }
+
+    // Call right after parse_input, before reconcile_network rewrites the model
+    void check(const SimModel &model) {
+        if (expected.round < 0 || model.round != expected.round + 1)
+            return;
+        rounds++;
+
+        int interest = expected.resources_left * MONTHLY_INTEREST_PERCENT / 100;
+        int income = model.resources - expected.resources_left - interest;
+        if (income_rounds == 0)
+            income_seen = income;
+        else
+            resource_error += std::abs(income - income_seen);
+        income_rounds++;
+
+        std::map<std::pair<int, int>, int> reported;
+        for (const auto &[b1, b2, capacity]: model.reported_links)
+            reported[capacity == 0 ? std::make_pair(b1, b2) : tube_key(b1, b2)] = capacity;
+        int links_off = 0;
+        for (const auto &[ends, capacity]: expected.capacities) {
+            auto it = reported.find(ends);
+            links_off += it == reported.end() || it->second != capacity;
+        }
+        for (const auto &[ends, capacity]: reported)
+            links_off += !expected.capacities.count(ends);
+
+        int pods_off = 0;
+        for (const auto &[id, route]: expected.pods) {
+            auto it = model.reported_pods.find(id);
+            pods_off += it == model.reported_pods.end() || it->second != route;
+        }
+        for (const auto &[id, route]: model.reported_pods)
+            pods_off += !expected.pods.count(id);
+
+        links_checked += std::max(expected.capacities.size(), reported.size());
+        pods_checked += std::max(expected.pods.size(), model.reported_pods.size());
+        link_errors += links_off;
+        pod_errors += pods_off;
+        log("Telemetry: round " + std::to_string(expected.round) + " forecast " + std::to_string(expected.points)
+            + " points, income " + std::to_string(income) + ", links off " + std::to_string(links_off)
+            + ", pods off " + std::to_string(pods_off));
+    }
+
+    void report() const {
+        std::ostringstream ss;
+        ss << "TELEMETRY rounds " << rounds
+           << " income " << income_seen << " drift " << resource_error
+           << " links " << link_errors << "/" << links_checked
+           << " pods " << pod_errors << "/" << pods_checked
+           << " forecast_points " << predicted_points;
+        log(ss.str());
+        if (std::string(TELEMETRY_FILE).size() > 0)
+            std::ofstream(TELEMETRY_FILE, std::ios::app) << ss.str() << std::endl;
+    }
+
+private:
+    TurnExpectation expected;
+    int         rounds = 0;
+    int         income_seen = 0, income_rounds = 0;
+    long long   resource_error = 0;         // Sum of |income - first income| over the turns
+    size_t      links_checked = 0, link_errors = 0;
+    size_t      pods_checked = 0, pod_errors = 0;
+    long long   predicted_points = 0;
+};
+
 //  ███    ███  █████  ██ ███    ██
 //  ████  ████ ██   ██ ██ ████   ██
 //  ██ ████ ██ ███████ ██ ██ ██  ██
 //  ██  ██  ██ ██   ██ ██ ██  ██ ██
 //  ██      ██ ██   ██ ██ ██   ████
 
+// Tools (bench.cpp) include this file to drive the planner themselves
+#ifndef JI_NO_MAIN
 int main() {
 
     SimModel model;
+    Ponderer ponderer;
+    ponderer.start();
+    Telemetry telemetry;
 
     while (true) {
-        debug_time(1);
-        model.parse_input();
+        if (!model.parse_input())
+            break;
+        telemetry.check(model);
+        reconcile_network(model);
+        debug_time(1); // The clock starts once the input is in, pondering happened before
+        model.pondered.reset(ponderer.take(model));
         std::cerr << "Parsing Done;"; debug_time(0);
         semi_optimal_algorithm(model);
+        ponderer.submit(new GeometrySnapshot(model)); // Before flushing so the worker starts while the referee plays the month
         close_round();
+        telemetry.expect(model); // Once flushed, the referee's clock is no longer running
         std::cerr << "Round time:";debug_time(0);
-
     }
+    telemetry.report();
     return 0;
 }
+#endif
@@ -0,0 +1,157 @@
+#ifndef MAPGEN_HPP
+#define MAPGEN_HPP
+
+#include <random>
+#include <algorithm>
+#include <vector>
+#include <set>
+#include <map>
+#include <string>
+#include <sstream>
+#include <cstdint>
+#include <cmath>
+
+/**
+ * Seeded map generator shared by the referee and the benchmarks
+ *
+ * A map is a list of buildings revealed wave by wave (one wave per month),
+ * plus the resources handed out at the start of the game and each month after.
+ * The map is 160x90 km, buildings sit on integer coordinates and never share one.
+ */
+
+#define MAP_WIDTH 160
+#define MAP_HEIGHT 90
+#define MAP_MONTHS 20
+
+struct MapBuilding {
+    int                 id;
+    int                 type;   // 0 for landing pads, module type otherwise
+    int                 x, y;
+    std::vector<int>    astronauts; // Types of the astronauts landing each month (pads only)
+
+    std::string to_input_line() const {
+        std::ostringstream ss;
+        if (type == 0) {
+            ss << 0 << " " << id << " " << x << " " << y << " " << astronauts.size();
+            for (int t : astronauts)
+                ss << " " << t;
+        } else {
+            ss << type << " " << id << " " << x << " " << y;
+        }
+        return ss.str();
+    }
+};
+
+struct GameMap {
+    uint32_t                                seed = 0;
+    int                                     initial_resources = 0;
+    int                                     monthly_income = 0;
+    std::vector<std::vector<MapBuilding>>   waves; // waves[month] = buildings revealed that month
+
+    size_t building_count() const {
+        size_t n = 0;
+        for (const auto &wave : waves)
+            n += wave.size();
+        return n;
+    }
+};
+
+enum MapLayout { UNIFORM, CLUSTERED };
+
+struct MapParams {
+    uint32_t    seed = 0;
+    MapLayout   layout = UNIFORM;
+    int         clusters = 4;           // Number of cluster centers for CLUSTERED layouts
+    int         buildings = 12;         // Total number of buildings over the whole game
+    int         types = 4;              // Number of distinct module types [1, 20]
+    int         min_astronauts = 10;    // Astronauts per pad per month
+    int         max_astronauts = 40;
+    float       pad_ratio = 0.3f;       // Share of pads amongst the buildings
+    float       first_wave_ratio = 0.4f;// Share of the buildings revealed on the first month
+    int         initial_resources = 4000;
+    int         monthly_income = 1500;
+};
+
+class MapGenerator {
+    std::mt19937                    rng;
+    std::set<std::pair<int, int>>   taken;
+
+    int rand_int(int lo, int hi) {
+        return std::uniform_int_distribution<int>(lo, hi)(rng);
+    }
+
+    std::vector<std::pair<int, int>>    centers;
+
+    std::pair<int, int> free_spot(MapLayout layout) {
+        std::normal_distribution<double> spread(0.0, 8.0);
+        for (int attempt = 0; ; attempt++) {
+            int x, y;
+            if (layout == CLUSTERED && !centers.empty() && attempt < 100) {
+                const auto &c = centers[rand_int(0, centers.size() - 1)];
+                x = std::clamp((int)std::lround(c.first + spread(rng)), 0, MAP_WIDTH);
+                y = std::clamp((int)std::lround(c.second + spread(rng)), 0, MAP_HEIGHT);
+            } else {
+                x = rand_int(0, MAP_WIDTH);
+                y = rand_int(0, MAP_HEIGHT);
+            }
+            if (taken.insert({x, y}).second)
+                return {x, y};
+        }
+    }
+
+public:
+    GameMap generate(const MapParams &p) {
+        rng.seed(p.seed);
+        taken.clear();
+        centers.clear();
+        if (p.layout == CLUSTERED)
+            for (int i = 0; i < std::max(1, p.clusters); i++)
+                centers.push_back({rand_int(10, MAP_WIDTH - 10), rand_int(10, MAP_HEIGHT - 10)});
+
+        GameMap map;
+        map.seed = p.seed;
+        map.initial_resources = p.initial_resources;
+        map.monthly_income = p.monthly_income;
+        map.waves.resize(MAP_MONTHS);
+
+        int total = std::max(2, p.buildings);
+        int pads = std::max(1, (int)(total * p.pad_ratio));
+        int modules = std::max(1, total - pads);
+        int types = std::max(1, std::min({20, p.types, modules}));
+
+        // One module of each type first so every astronaut has somewhere to go
+        std::vector<MapBuilding> all;
+        for (int i = 0; i < modules; i++) {
+            auto [x, y] = free_spot(p.layout);
+            int type = i < types ? i + 1 : rand_int(1, types);
+            all.push_back({0, type, x, y, {}});
+        }
+        for (int i = 0; i < pads; i++) {
+            auto [x, y] = free_spot(p.layout);
+            MapBuilding pad{0, 0, x, y, {}};
+            int n = rand_int(p.min_astronauts, std::max(p.min_astronauts, p.max_astronauts));
+            for (int k = 0; k < n; k++)
+                pad.astronauts.push_back(rand_int(1, types));
+            all.push_back(pad);
+        }
+
+        // First wave: the first pad and enough modules to serve it, then random reveals
+        std::vector<int> order(all.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        std::shuffle(order.begin() + types, order.end(), rng);
+        std::stable_partition(order.begin(), order.end(), [&](int i) { return i < types || i == modules; });
+
+        size_t first = std::max((size_t)types + 1, (size_t)(all.size() * p.first_wave_ratio));
+        first = std::min(first, all.size());
+        for (size_t k = 0; k < order.size(); k++) {
+            int month = 0;
+            if (k >= first)
+                month = 1 + (int)((k - first) * (MAP_MONTHS - 1) / std::max((size_t)1, order.size() - first));
+            all[order[k]].id = k;
+            map.waves[month].push_back(all[order[k]]);
+        }
+        return map;
+    }
+};
+
+#endif
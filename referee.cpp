@@ -0,0 +1,586 @@
+/**
+ * Local referee: plays a full 20-month game against a bot binary over stdin/stdout
+ *
+ * Build:   g++ -std=c++17 -O2 referee.cpp -o referee
+ * Usage:   ./referee [options] -- <bot command>
+ *      --seed N            Map seed (default 0)
+ *      --buildings N       Total buildings over the game (default 12)
+ *      --types N           Module types (default 4)
+ *      --layout L          uniform or clustered (default uniform)
+ *      --astronauts A B    Astronauts per pad per month, between A and B
+ *      --resources N       Starting resources
+ *      --income N          Resources received at the start of every month after the first
+ *      --no-timeout        Do not enforce the 1000/500 ms limits
+ *      --bot-stderr        Let the bot write its logs to our stderr
+ *      --verbose           Print a line per month and every rejected action
+ *
+ * The last line on stdout is always:
+ *      SCORE <score> POINTS <points> RESOURCES <resources> STATUS <ok|timeout|crash> MONTHS <played> REJECTED <actions>
+ *
+ * Rules follow rules.md, plus the details the statement gives elsewhere:
+ *  - A tube costs 1 resource per 0.1 km (floor), an upgrade costs initial-cost * (capacity + 1), max capacity 3
+ *  - Tubes cannot cross other tubes nor pass through a building, at most 5 tubes per building
+ *  - A building hosts at most one teleporter end, a teleporter costs 5000
+ *  - A pod costs 1000, holds 10 astronauts, DESTROY refunds 750
+ *  - Pods restart from their first stop every month, closed paths loop and open ones bounce back
+ *  - Resources earn 10% interest at the start of every month, on top of the map income
+ *  - Astronauts score (50 - days travelled) + (50 - astronauts already in that module this month), floored at 0
+ *  - The final score is the total points plus the resources left
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "mapgen.hpp"
+
+#define DAYS_PER_MONTH 20
+#define POD_PRICE 1000
+#define POD_REFUND 750
+#define POD_CAPACITY 10
+#define TUBE_PRICE 10
+#define TELEPORTER_PRICE 5000
+#define MAX_TUBE_CAPACITY 3
+#define MAX_TUBES_PER_BUILDING 5
+#define FIRST_ROUND_TIMEOUT_MS 1000
+#define ROUND_TIMEOUT_MS 500
+#define UNREACHABLE 1000000
+
+// ██████   ██████  ████████
+// ██   ██ ██    ██    ██
+// ██████  ██    ██    ██
+// ██   ██ ██    ██    ██
+// ██████   ██████     ██
+
+class BotProcess {
+    pid_t       pid = -1;
+    int         to_bot = -1;
+    int         from_bot = -1;
+    std::string pending;
+
+public:
+    bool start(const std::string &cmd, bool keep_stderr) {
+        int in_pipe[2], out_pipe[2];
+        if (pipe(in_pipe) != 0 || pipe(out_pipe) != 0)
+            return false;
+        pid = fork();
+        if (pid < 0)
+            return false;
+        if (pid == 0) {
+            dup2(in_pipe[0], STDIN_FILENO);
+            dup2(out_pipe[1], STDOUT_FILENO);
+            if (!keep_stderr) {
+                int devnull = open("/dev/null", O_WRONLY);
+                dup2(devnull, STDERR_FILENO);
+            }
+            close(in_pipe[1]); close(out_pipe[0]);
+            execl("/bin/sh", "sh", "-c", cmd.c_str(), (char *)nullptr);
+            _exit(127);
+        }
+        close(in_pipe[0]); close(out_pipe[1]);
+        to_bot = in_pipe[1];
+        from_bot = out_pipe[0];
+        return true;
+    }
+
+    bool send(const std::string &data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = write(to_bot, data.data() + done, data.size() - done);
+            if (n <= 0)
+                return false;
+            done += n;
+        }
+        return true;
+    }
+
+    /**
+     * Returns:
+     *  1 and the line when the bot answered in time
+     *  0 on timeout (timeout_ms < 0 waits forever)
+     *  -1 if the bot died
+     */
+    int read_line(std::string &line, int timeout_ms) {
+        auto start = std::chrono::steady_clock::now();
+        while (true) {
+            size_t nl = pending.find('\n');
+            if (nl != std::string::npos) {
+                line = pending.substr(0, nl);
+                pending.erase(0, nl + 1);
+                return 1;
+            }
+            int wait_ms = -1;
+            if (timeout_ms >= 0) {
+                auto spent = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+                if (spent >= timeout_ms)
+                    return 0;
+                wait_ms = timeout_ms - spent;
+            }
+            struct pollfd pfd = {from_bot, POLLIN, 0};
+            int ret = poll(&pfd, 1, wait_ms);
+            if (ret == 0)
+                return 0;
+            if (ret < 0)
+                return -1;
+            char buffer[4096];
+            ssize_t n = read(from_bot, buffer, sizeof(buffer));
+            if (n <= 0)
+                return -1;
+            pending.append(buffer, n);
+        }
+    }
+
+    void stop() {
+        if (pid <= 0)
+            return;
+        close(to_bot);
+        close(from_bot);
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        pid = -1;
+    }
+
+    ~BotProcess() { stop(); }
+};
+
+//  ██████   █████  ███    ███ ███████
+// ██       ██   ██ ████  ████ ██
+// ██   ███ ███████ ██ ████ ██ █████
+// ██    ██ ██   ██ ██  ██  ██ ██
+//  ██████  ██   ██ ██      ██ ███████
+
+struct RefTube {
+    int a, b;           // a < b
+    int capacity;
+    int initial_cost;
+};
+
+struct RefPod {
+    int                 id;
+    std::vector<int>    path;
+    size_t              index = 0;
+    int                 direction = 1;
+    int                 passengers = 0;
+    bool                moving = false;
+    int                 next = -1;
+};
+
+struct Astronaut {
+    int     type;
+    int     at;
+    bool    arrived = false;
+};
+
+class Game {
+public:
+    GameMap                             map;
+    int                                 resources;
+    long long                           points = 0;
+    int                                 rejected_actions = 0;
+    bool                                verbose = false;
+
+    std::map<int, MapBuilding>          buildings;
+    std::map<std::pair<int, int>, RefTube>  tubes;
+    std::map<int, int>                  teleporters;    // {entrance: exit}
+    std::set<int>                       teleporter_ends;
+    std::map<int, int>                  tube_count;     // {building: tubes attached}
+    std::map<int, RefPod>               pods;
+
+    Game(const GameMap &map) : map(map), resources(map.initial_resources) {}
+
+    static std::pair<int, int> key(int a, int b) {
+        return a < b ? std::make_pair(a, b) : std::make_pair(b, a);
+    }
+
+    static long long cross(const MapBuilding &o, const MapBuilding &a, const MapBuilding &b) {
+        return (long long)(a.x - o.x) * (b.y - o.y) - (long long)(a.y - o.y) * (b.x - o.x);
+    }
+
+    static int sign(long long v) {
+        return (v > 0) - (v < 0);
+    }
+
+    void reject(const std::string &action, const std::string &why) {
+        rejected_actions++;
+        if (verbose)
+            std::cerr << "Rejected '" << action << "': " << why << std::endl;
+    }
+
+    int tube_cost(int a, int b) const {
+        const MapBuilding &A = buildings.at(a), &B = buildings.at(b);
+        return (int)std::floor(std::sqrt((double)(A.x - B.x) * (A.x - B.x) + (double)(A.y - B.y) * (A.y - B.y)) * TUBE_PRICE);
+    }
+
+    bool tube_geometry_ok(int a, int b) const {
+        const MapBuilding &A = buildings.at(a), &B = buildings.at(b);
+        for (const auto &[id, C] : buildings) {
+            if (id == a || id == b)
+                continue;
+            if (cross(A, B, C) == 0
+                && std::min(A.x, B.x) <= C.x && C.x <= std::max(A.x, B.x)
+                && std::min(A.y, B.y) <= C.y && C.y <= std::max(A.y, B.y))
+                return false;
+        }
+        for (const auto &[k, tube] : tubes) {
+            if (tube.a == a || tube.a == b || tube.b == a || tube.b == b)
+                continue;
+            const MapBuilding &C = buildings.at(tube.a), &D = buildings.at(tube.b);
+            if (sign(cross(A, B, C)) * sign(cross(A, B, D)) < 0 && sign(cross(C, D, A)) * sign(cross(C, D, B)) < 0)
+                return false;
+        }
+        return true;
+    }
+
+    void do_tube(const std::string &action, int a, int b) {
+        if (!buildings.count(a) || !buildings.count(b) || a == b)
+            return reject(action, "unknown buildings");
+        if (tubes.count(key(a, b)))
+            return reject(action, "tube already exists");
+        if (tube_count[a] >= MAX_TUBES_PER_BUILDING || tube_count[b] >= MAX_TUBES_PER_BUILDING)
+            return reject(action, "too many tubes on a building");
+        if (!tube_geometry_ok(a, b))
+            return reject(action, "crosses a tube or a building");
+        int cost = tube_cost(a, b);
+        if (cost > resources)
+            return reject(action, "not enough resources");
+        resources -= cost;
+        tubes[key(a, b)] = {std::min(a, b), std::max(a, b), 1, cost};
+        tube_count[a]++;
+        tube_count[b]++;
+    }
+
+    void do_upgrade(const std::string &action, int a, int b) {
+        auto it = tubes.find(key(a, b));
+        if (it == tubes.end())
+            return reject(action, "no such tube");
+        if (it->second.capacity >= MAX_TUBE_CAPACITY)
+            return reject(action, "tube at max capacity");
+        int cost = it->second.initial_cost * (it->second.capacity + 1);
+        if (cost > resources)
+            return reject(action, "not enough resources");
+        resources -= cost;
+        it->second.capacity++;
+    }
+
+    void do_teleport(const std::string &action, int a, int b) {
+        if (!buildings.count(a) || !buildings.count(b) || a == b)
+            return reject(action, "unknown buildings");
+        if (teleporter_ends.count(a) || teleporter_ends.count(b))
+            return reject(action, "building already has a teleporter");
+        if (TELEPORTER_PRICE > resources)
+            return reject(action, "not enough resources");
+        resources -= TELEPORTER_PRICE;
+        teleporters[a] = b;
+        teleporter_ends.insert(a);
+        teleporter_ends.insert(b);
+    }
+
+    void do_pod(const std::string &action, int id, const std::vector<int> &path) {
+        if (pods.count(id))
+            return reject(action, "pod id already used");
+        if (path.size() < 2)
+            return reject(action, "path too short");
+        for (size_t i = 0; i + 1 < path.size(); i++)
+            if (!tubes.count(key(path[i], path[i + 1])))
+                return reject(action, "stops not linked by a tube");
+        if (POD_PRICE > resources)
+            return reject(action, "not enough resources");
+        resources -= POD_PRICE;
+        RefPod pod;
+        pod.id = id;
+        pod.path = path;
+        pods[id] = pod;
+    }
+
+    void do_destroy(const std::string &action, int id) {
+        if (!pods.erase(id))
+            return reject(action, "no such pod");
+        resources += POD_REFUND;
+    }
+
+    void apply_actions(const std::string &line) {
+        std::stringstream all(line);
+        std::string action;
+        while (std::getline(all, action, ';')) {
+            std::istringstream ss(action);
+            std::string verb;
+            if (!(ss >> verb) || verb == "WAIT")
+                continue;
+            std::vector<int> args;
+            int v;
+            while (ss >> v)
+                args.push_back(v);
+            if (verb == "TUBE" && args.size() == 2)
+                do_tube(action, args[0], args[1]);
+            else if (verb == "UPGRADE" && args.size() == 2)
+                do_upgrade(action, args[0], args[1]);
+            else if (verb == "TELEPORT" && args.size() == 2)
+                do_teleport(action, args[0], args[1]);
+            else if (verb == "POD" && args.size() >= 1)
+                do_pod(action, args[0], std::vector<int>(args.begin() + 1, args.end()));
+            else if (verb == "DESTROY" && args.size() == 1)
+                do_destroy(action, args[0]);
+            else
+                reject(action, "malformed");
+        }
+    }
+
+    std::string round_input(int month) const {
+        std::ostringstream ss;
+        ss << resources << "\n";
+        ss << tubes.size() + teleporters.size() << "\n";
+        for (const auto &[k, tube] : tubes)
+            ss << tube.a << " " << tube.b << " " << tube.capacity << "\n";
+        for (const auto &[entrance, exit] : teleporters)
+            ss << entrance << " " << exit << " " << 0 << "\n";
+        ss << pods.size() << "\n";
+        for (const auto &[id, pod] : pods) {
+            ss << id << " " << pod.path.size();
+            for (int stop : pod.path)
+                ss << " " << stop;
+            ss << "\n";
+        }
+        ss << map.waves[month].size() << "\n";
+        for (const auto &building : map.waves[month])
+            ss << building.to_input_line() << "\n";
+        return ss.str();
+    }
+
+    void reveal(int month) {
+        for (const auto &building : map.waves[month])
+            buildings[building.id] = building;
+    }
+
+    /**
+     * Hop distance from every building to the nearest module of `type`
+     * Tubes cost one day both ways, teleporters are free but one-way
+     */
+    std::map<int, int> distances_to_type(int type) const {
+        std::map<int, std::vector<std::pair<int, int>>> reverse_adjacency;
+        for (const auto &[k, tube] : tubes) {
+            reverse_adjacency[tube.a].push_back({tube.b, 1});
+            reverse_adjacency[tube.b].push_back({tube.a, 1});
+        }
+        for (const auto &[entrance, exit] : teleporters)
+            reverse_adjacency[exit].push_back({entrance, 0});
+
+        std::map<int, int> dist;
+        for (const auto &[id, b] : buildings)
+            dist[id] = UNREACHABLE;
+        std::deque<int> q;
+        for (const auto &[id, b] : buildings) {
+            if (b.type == type) {
+                dist[id] = 0;
+                q.push_back(id);
+            }
+        }
+        while (!q.empty()) {
+            int current = q.front();
+            q.pop_front();
+            for (const auto &[neighbor, w] : reverse_adjacency[current]) {
+                if (dist[current] + w < dist[neighbor]) {
+                    dist[neighbor] = dist[current] + w;
+                    if (w == 0) q.push_front(neighbor);
+                    else q.push_back(neighbor);
+                }
+            }
+        }
+        return dist;
+    }
+
+    void score_arrival(Astronaut &dude, int days, std::map<int, int> &module_population) {
+        dude.arrived = true;
+        int speed = std::max(0, 50 - days);
+        int balance = std::max(0, 50 - module_population[dude.at]);
+        module_population[dude.at]++;
+        points += speed + balance;
+    }
+
+    void advance_index(RefPod &pod) const {
+        bool closed = pod.path.front() == pod.path.back();
+        if (closed) {
+            pod.index++;
+            if (pod.index + 1 >= pod.path.size())
+                pod.index = 0;
+            return;
+        }
+        if ((pod.direction > 0 && pod.index + 1 >= pod.path.size()) || (pod.direction < 0 && pod.index == 0))
+            pod.direction = -pod.direction;
+        pod.index += pod.direction;
+    }
+
+    int next_stop(const RefPod &pod) const {
+        RefPod copy = pod;
+        advance_index(copy);
+        return copy.path[copy.index];
+    }
+
+    void run_month(int month) {
+        std::map<int, std::map<int, int>> dist;
+        std::vector<Astronaut> dudes;
+        for (const auto &[id, b] : buildings) {
+            if (b.type != 0)
+                continue;
+            for (int type : b.astronauts) {
+                if (!dist.count(type))
+                    dist[type] = distances_to_type(type);
+                dudes.push_back({type, id});
+            }
+        }
+        for (auto &[id, pod] : pods) {
+            pod.index = 0;
+            pod.direction = 1;
+        }
+
+        std::map<int, int> module_population;
+        long long before = points;
+        for (int day = 1; day <= DAYS_PER_MONTH; day++) {
+            // 1. Teleporters
+            for (auto &dude : dudes) {
+                if (dude.arrived)
+                    continue;
+                auto tp = teleporters.find(dude.at);
+                if (tp == teleporters.end())
+                    continue;
+                const auto &d = dist[dude.type];
+                if (d.at(dude.at) >= UNREACHABLE || d.at(tp->second) > d.at(dude.at))
+                    continue;
+                dude.at = tp->second;
+                if (buildings.at(dude.at).type == dude.type)
+                    score_arrival(dude, day - 1, module_population);
+            }
+            // 2. Pods into tubes, smallest ids first
+            std::map<std::pair<int, int>, int> usage;
+            for (auto &[id, pod] : pods) {
+                pod.passengers = 0;
+                pod.next = next_stop(pod);
+                auto k = key(pod.path[pod.index], pod.next);
+                auto tube = tubes.find(k);
+                pod.moving = tube != tubes.end() && usage[k] < tube->second.capacity;
+                if (pod.moving)
+                    usage[k]++;
+            }
+            // 3. Boarding, astronauts from lower pad ids pick first
+            std::map<Astronaut *, RefPod *> seat;
+            for (auto &dude : dudes) {
+                if (dude.arrived)
+                    continue;
+                const auto &d = dist[dude.type];
+                for (auto &[id, pod] : pods) {
+                    if (!pod.moving || pod.path[pod.index] != dude.at || pod.passengers >= POD_CAPACITY)
+                        continue;
+                    if (d.at(pod.next) >= d.at(dude.at))
+                        continue;
+                    pod.passengers++;
+                    seat[&dude] = &pod;
+                    break;
+                }
+            }
+            // 4. Launch
+            for (auto &[dude, pod] : seat) {
+                dude->at = pod->next;
+                if (buildings.at(dude->at).type == dude->type)
+                    score_arrival(*dude, day, module_population);
+            }
+            for (auto &[id, pod] : pods)
+                if (pod.moving)
+                    advance_index(pod);
+        }
+        if (verbose) {
+            size_t arrived = std::count_if(dudes.begin(), dudes.end(), [](const Astronaut &a) { return a.arrived; });
+            std::cerr << "Month " << month << ": arrived " << arrived << "/" << dudes.size()
+                      << " points +" << (points - before) << " resources " << resources << std::endl;
+        }
+    }
+};
+
+//  ███    ███  █████  ██ ███    ██
+//  ████  ████ ██   ██ ██ ████   ██
+//  ██ ████ ██ ███████ ██ ██ ██  ██
+//  ██  ██  ██ ██   ██ ██ ██  ██ ██
+//  ██      ██ ██   ██ ██ ██   ████
+
+int main(int argc, char **argv) {
+    MapParams params;
+    bool enforce_timeout = true, keep_stderr = false, verbose = false;
+    std::string bot_cmd;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto next = [&]() { return i + 1 < argc ? std::atoi(argv[++i]) : 0; };
+        if (arg == "--seed") params.seed = next();
+        else if (arg == "--buildings") params.buildings = next();
+        else if (arg == "--types") params.types = next();
+        else if (arg == "--layout") params.layout = (i + 1 < argc && std::string(argv[++i]) == "clustered") ? CLUSTERED : UNIFORM;
+        else if (arg == "--astronauts") { params.min_astronauts = next(); params.max_astronauts = next(); }
+        else if (arg == "--resources") params.initial_resources = next();
+        else if (arg == "--income") params.monthly_income = next();
+        else if (arg == "--no-timeout") enforce_timeout = false;
+        else if (arg == "--bot-stderr") keep_stderr = true;
+        else if (arg == "--verbose") verbose = true;
+        else if (arg == "--") {
+            for (i++; i < argc; i++)
+                bot_cmd += std::string(bot_cmd.empty() ? "" : " ") + argv[i];
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (bot_cmd.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [options] -- <bot command>" << std::endl;
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    MapGenerator generator;
+    Game game(generator.generate(params));
+    game.verbose = verbose;
+
+    BotProcess bot;
+    if (!bot.start(bot_cmd, keep_stderr)) {
+        std::cerr << "Could not start bot" << std::endl;
+        return 1;
+    }
+
+    std::string status = "ok";
+    int month = 0;
+    for (; month < MAP_MONTHS; month++) {
+        if (month > 0)
+            game.resources += game.resources / 10 + game.map.monthly_income;
+        game.reveal(month);
+
+        int timeout = !enforce_timeout ? -1 : (month == 0 ? FIRST_ROUND_TIMEOUT_MS : ROUND_TIMEOUT_MS);
+        std::string answer;
+        auto start = std::chrono::steady_clock::now();
+        int ret = bot.send(game.round_input(month)) ? bot.read_line(answer, timeout) : -1;
+        auto spent = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        if (ret == 0) { status = "timeout"; break; }
+        if (ret < 0) { status = "crash"; break; }
+        if (verbose)
+            std::cerr << "Month " << month << ": answered in " << spent << "ms: " << answer << std::endl;
+
+        game.apply_actions(answer);
+        game.run_month(month);
+    }
+    bot.stop();
+
+    std::cout << "SCORE " << game.points + game.resources << " POINTS " << game.points
+              << " RESOURCES " << game.resources << " STATUS " << status << " MONTHS " << month
+              << " REJECTED " << game.rejected_actions << std::endl;
+    return 0;
+}
@@ -0,0 +1,201 @@
+/**
+ * Planner tuning: random search over the PLANNER_PARAMS ranges, games played in parallel
+ *
+ * Build:   g++ -std=c++17 -O2 -pthread tune.cpp -o tune
+ * Usage:   ./tune [options] > tune_output.txt
+ *      --referee PATH      Referee binary (default ./referee)
+ *      --bot PATH          Bot binary, it reads the vector from JI_PARAMS (default ./ji)
+ *      --buildings a,b,c   Map sizes of the corpus (default 15,40,80)
+ *      --seeds N           Maps per size (default 4)
+ *      --iterations N      Parameter vectors tried (default 50)
+ *      --jobs N            Games played at once (default: cores / (SEARCH_ISLANDS + 1), each bot
+ *                          runs that many threads against wall-clock deadlines)
+ *      --top N             Best vectors reported at the end (default 5)
+ *      --search-seed N     Seed of the search itself (default 0)
+ *
+ * A vector scores the mean referee score over the corpus. Games whose STATUS is not ok
+ * (timeout, crash, no result line) are left out of the mean and counted, and a vector with
+ * any of them is reported but never kept as the best. The first one is the defaults,
+ * the next ones are drawn around the best so far with a step shrinking from half the
+ * range down to a twentieth of it.
+ *
+ * Output is CSV, one line per vector:
+ *      iteration,mean_score,failed_games,params
+ * then the best vectors, as ready to paste JI_PARAMS values.
+ */
+
+#include <cstdio>
+#include <type_traits>
+
+#define JI_NO_MAIN
+#include "ji.cpp"
+
+// ██████   █████  ███    ██  ██████  ███████ ███████
+// ██   ██ ██   ██ ████   ██ ██       ██      ██
+// ██████  ███████ ██ ██  ██ ██   ███ █████   ███████
+// ██   ██ ██   ██ ██  ██ ██ ██    ██ ██           ██
+// ██   ██ ██   ██ ██   ████  ██████  ███████ ███████
+
+struct ParamRange {
+    const char  *name;
+    double      value, lowest, highest;
+    bool        integer;
+};
+
+static const std::vector<ParamRange> ranges = {
+#define X(type, name, def, lowest, highest, doc) {#name, (double)(def), (double)(lowest), (double)(highest), std::is_integral<type>::value},
+    PLANNER_PARAMS(X)
+#undef X
+};
+
+typedef std::vector<double> t_vector;
+
+static std::string to_params(const t_vector &v) {
+    std::ostringstream ss;
+    for (size_t i = 0; i < ranges.size(); i++)
+        ss << (i ? "," : "") << ranges[i].name << "=" << v[i];
+    return ss.str();
+}
+
+static t_vector perturb(const t_vector &from, double step, std::mt19937 &rng) {
+    t_vector v = from;
+    for (size_t i = 0; i < ranges.size(); i++) {
+        double width = ranges[i].highest - ranges[i].lowest;
+        v[i] = std::normal_distribution<double>(from[i], step * width)(rng);
+        v[i] = std::clamp(v[i], ranges[i].lowest, ranges[i].highest);
+        if (ranges[i].integer)
+            v[i] = std::round(v[i]);
+    }
+    return v;
+}
+
+//  ██████   █████  ███    ███ ███████ ███████
+// ██       ██   ██ ████  ████ ██      ██
+// ██   ███ ███████ ██ ████ ██ █████   ███████
+// ██    ██ ██   ██ ██  ██  ██ ██           ██
+//  ██████  ██   ██ ██      ██ ███████ ███████
+
+struct TuneConfig {
+    std::string         referee = "./referee", bot = "./ji";
+    std::vector<int>    buildings = {15, 40, 80};
+    int                 seeds = 4;
+};
+
+// Final score of one game, -1 if it did not end with STATUS ok
+static long long play(const TuneConfig &cfg, const std::string &params, int buildings, int seed) {
+    std::string command = "JI_PARAMS='" + params + "' " + cfg.referee + " --seed " + std::to_string(seed)
+        + " --buildings " + std::to_string(buildings) + " -- " + cfg.bot + " 2>/dev/null";
+    FILE *pipe = popen(command.c_str(), "r");
+    if (pipe == nullptr)
+        return -1;
+    long long score = -1;
+    char line[512], status[32];
+    while (std::fgets(line, sizeof(line), pipe)) {
+        long long points, resources;
+        if (std::sscanf(line, "SCORE %lld POINTS %lld RESOURCES %lld STATUS %31s", &score, &points, &resources, status) == 4
+            && std::string(status) != "ok")
+            score = -1;
+    }
+    pclose(pipe);
+    return score;
+}
+
+struct Evaluation {
+    double  mean = 0;   // Over the games that ended ok
+    int     failed = 0;
+};
+
+// Mean score over the corpus, the games run `jobs` at a time
+static Evaluation evaluate(const TuneConfig &cfg, const t_vector &v, int jobs) {
+    std::vector<std::pair<int, int>> games;
+    for (int b: cfg.buildings)
+        for (int seed = 0; seed < cfg.seeds; seed++)
+            games.push_back({b, seed});
+    std::string params = to_params(v);
+    std::vector<long long> scores(games.size());
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i; (i = next++) < games.size();)
+            scores[i] = play(cfg, params, games[i].first, games[i].second);
+    };
+    std::vector<std::thread> pool;
+    for (int j = 0; j < jobs; j++)
+        pool.emplace_back(worker);
+    for (auto &thread: pool)
+        thread.join();
+    Evaluation result;
+    double total = 0;
+    for (long long score: scores) {
+        if (score < 0)
+            result.failed++;
+        else
+            total += score;
+    }
+    int played = (int)scores.size() - result.failed;
+    result.mean = played > 0 ? total / played : 0;
+    return result;
+}
+
+static std::vector<int> parse_list(const char *arg) {
+    std::vector<int> values;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        values.push_back(std::atoi(item.c_str()));
+    return values;
+}
+
+int main(int argc, char **argv) {
+    TuneConfig cfg;
+    int iterations = 50, top = 5;
+    int jobs = std::max(1, (int)std::thread::hardware_concurrency() / (SEARCH_ISLANDS + 1));
+    uint32_t search_seed = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--referee") cfg.referee = argv[i + 1];
+        else if (arg == "--bot") cfg.bot = argv[i + 1];
+        else if (arg == "--buildings") cfg.buildings = parse_list(argv[i + 1]);
+        else if (arg == "--seeds") cfg.seeds = std::atoi(argv[i + 1]);
+        else if (arg == "--iterations") iterations = std::atoi(argv[i + 1]);
+        else if (arg == "--jobs") jobs = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--top") top = std::atoi(argv[i + 1]);
+        else if (arg == "--search-seed") search_seed = std::atoi(argv[i + 1]);
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::mt19937 rng(search_seed);
+    t_vector best;
+    for (const auto &range: ranges)
+        best.push_back(range.value);
+    double best_score = -1;
+    std::vector<std::pair<double, t_vector>> tried;
+
+    std::cout << "iteration,mean_score,failed_games,params\n";
+    for (int it = 0; it < iterations; it++) {
+        double step = 0.5 * std::pow(0.1, (double)it / std::max(1, iterations - 1));
+        t_vector v = it == 0 ? best : perturb(best, step, rng);
+        Evaluation evaluation = evaluate(cfg, v, jobs);
+        double score = evaluation.mean;
+        std::cout << it << "," << (long long)score << "," << evaluation.failed << ",\"" << to_params(v) << "\"" << std::endl;
+        // Its mean is over fewer games, and a vector that times out is no candidate anyway
+        if (evaluation.failed > 0) {
+            std::cerr << "Vector " << it << ": " << evaluation.failed << " games did not end ok" << std::endl;
+            continue;
+        }
+        tried.push_back({score, v});
+        if (score > best_score) {
+            best_score = score;
+            best = v;
+        }
+    }
+
+    std::sort(tried.begin(), tried.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+    std::cout << "\nbest,mean_score,params\n";
+    for (int i = 0; i < top && i < (int)tried.size(); i++)
+        std::cout << i + 1 << "," << (long long)tried[i].first << ",\"" << to_params(tried[i].second) << "\"\n";
+    return 0;
+}